@@ -0,0 +1,81 @@
+#pragma once
+
+/* Affine transforms stored as the top three rows of a 4x4 matrix */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+/* the bottom row of an affine matrix is always (0, 0, 0, 1), so only the three rows above it are kept: 48 bytes instead
+of 64, and a product is 36 multiplies instead of 64. The rows upload as is to a std140 block of mat3x4, which GLSL reads
+as three columns; multiplying a row vector by it applies the transform:
+	layout (std140) uniform BonePalette { mat3x4 finalBonesMatrices[MAX_BONES]; };
+	vec3 skinned = vec4(pos, 1.0) * finalBonesMatrices[id]; */
+struct AffineTransform
+{
+	glm::vec4 rows[3];
+};
+
+inline AffineTransform IdentityAffine()
+{
+	AffineTransform result;
+	result.rows[0] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+	result.rows[1] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+	result.rows[2] = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+	return result;
+}
+
+/* translate(translation) * toMat4(rotation) * scale(scale), written out directly: the rotation's columns scaled by the
+scale and the translation in the last column, without building or multiplying three 4x4 matrices */
+inline AffineTransform ComposeAffine(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+{
+	const float xx = rotation.x * rotation.x, yy = rotation.y * rotation.y, zz = rotation.z * rotation.z;
+	const float xy = rotation.x * rotation.y, xz = rotation.x * rotation.z, yz = rotation.y * rotation.z;
+	const float wx = rotation.w * rotation.x, wy = rotation.w * rotation.y, wz = rotation.w * rotation.z;
+
+	AffineTransform result;
+	result.rows[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * scale.x, 2.0f * (xy - wz) * scale.y, 2.0f * (xz + wy) * scale.z, translation.x);
+	result.rows[1] = glm::vec4(2.0f * (xy + wz) * scale.x, (1.0f - 2.0f * (xx + zz)) * scale.y, 2.0f * (yz - wx) * scale.z, translation.y);
+	result.rows[2] = glm::vec4(2.0f * (xz - wy) * scale.x, 2.0f * (yz + wx) * scale.y, (1.0f - 2.0f * (xx + yy)) * scale.z, translation.z);
+	return result;
+}
+
+/* a * b, treating both as 4x4 matrices with a (0, 0, 0, 1) bottom row */
+inline AffineTransform MultiplyAffine(const AffineTransform& a, const AffineTransform& b)
+{
+	AffineTransform result;
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec4& row = a.rows[i];
+		result.rows[i] = b.rows[0] * row.x + b.rows[1] * row.y + b.rows[2] * row.z;
+		result.rows[i].w += row.w;
+	}
+	return result;
+}
+
+/* glm is column major: column c, row r of the matrix is matrix[c][r] */
+inline glm::mat4 AffineToMat4(const AffineTransform& affine)
+{
+	return glm::mat4(
+		affine.rows[0].x, affine.rows[1].x, affine.rows[2].x, 0.0f,
+		affine.rows[0].y, affine.rows[1].y, affine.rows[2].y, 0.0f,
+		affine.rows[0].z, affine.rows[1].z, affine.rows[2].z, 0.0f,
+		affine.rows[0].w, affine.rows[1].w, affine.rows[2].w, 1.0f);
+}
+
+/* drops the bottom row, which has to be (0, 0, 0, 1) for the result to mean the same thing */
+inline AffineTransform Mat4ToAffine(const glm::mat4& matrix)
+{
+	AffineTransform result;
+	for (int r = 0; r < 3; r++)
+		result.rows[r] = glm::vec4(matrix[0][r], matrix[1][r], matrix[2][r], matrix[3][r]);
+	return result;
+}
+
+/* a + (b - a) * factor, row by row */
+inline AffineTransform MixAffine(const AffineTransform& a, const AffineTransform& b, float factor)
+{
+	AffineTransform result;
+	for (int i = 0; i < 3; i++)
+		result.rows[i] = a.rows[i] + (b.rows[i] - a.rows[i]) * factor;
+	return result;
+}
@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 #include <learnopengl/bone.h>
+#include <glm/gtx/matrix_decompose.hpp>
 #include <functional>
 #include <learnopengl/animdata.h>
 #include <learnopengl/model_animation.h>
@@ -17,13 +18,66 @@ struct AssimpNodeData
 	std::vector<AssimpNodeData> children;
 };
 
+/* a node of the hierarchy with every name lookup already resolved to an index */
+struct SkeletonNode
+{
+	/*node transform used when no bone track animates it*/
+	glm::mat4 transformation;
+
+	/*same transform split into translation, rotation and scale, for blending poses*/
+	glm::vec3 bindTranslation;
+	glm::quat bindRotation;
+	glm::vec3 bindScale;
+
+	/*index of the parent in the skeleton array, -1 for the root. Always lower than the node's own index*/
+	int parent;
+
+	/*index of the Bone animating this node, -1 if none*/
+	int track;
+
+	/*longest path down to a leaf: 0 for leaves (fingers, face), 1 for their parents... skeleton LOD skips low ones*/
+	int height;
+
+	/*slot in finalBoneMatrices and offset matrix, -1 if the node isn't a bone of the mesh*/
+	int boneId;
+	glm::mat4 offset;
+
+	/*transformation and offset as affine rows, what the per-frame pass multiplies*/
+	AffineTransform bindLocal;
+	AffineTransform affineOffset;
+
+	/*false when neither the node nor any of its ancestors has a track, so its global transform never changes*/
+	bool animated;
+	/*global transform in bind pose, exact for every frame when the node isn't animated*/
+	AffineTransform bindGlobal;
+};
+
+/* position and heading of the root motion node at one key, in model space */
+struct RootMotionKey
+{
+	float timeStamp;
+	glm::vec3 translation;
+	/*rotation about +Y in radians, unwrapped so consecutive keys never jump by a full turn*/
+	float yaw;
+};
+
 class Animation
 {
 public:
 	Animation() = default;
 
-	Animation(const std::string& animationPath, Model* model)
+	/* with useCache the hierarchy and tracks are also written to a binary cache next to the file
+	(animationPath + ".anim.cache"), read back instead of importing for as long as the file is unchanged */
+	Animation(const std::string& animationPath, Model* model, bool useCache = true)
 	{
+		const std::string cachePath = animationPath + ".anim.cache";
+		if (useCache && LoadCache(cachePath, animationPath, *model))
+		{
+			BuildSkeleton(m_RootNode, -1);
+			ComputeSkeletonHeights();
+			return;
+		}
+
 		Assimp::Importer importer;
 		const aiScene* scene = importer.ReadFile(animationPath, aiProcess_Triangulate);
 		assert(scene && scene->mRootNode);
@@ -34,6 +88,10 @@ public:
 		globalTransformation = globalTransformation.Inverse();
 		ReadHierarchyData(m_RootNode, scene->mRootNode);
 		ReadMissingBones(animation, *model);
+		if (useCache)
+			SaveCache(cachePath, animationPath);
+		BuildSkeleton(m_RootNode, -1);
+		ComputeSkeletonHeights();
 	}
 
 	~Animation()
@@ -53,13 +111,188 @@ public:
 	}
 
 	
-	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
-	inline float GetDuration() { return m_Duration;}
+	inline float GetTicksPerSecond() const { return m_TicksPerSecond; }
+	inline float GetDuration() const { return m_Duration;}
 	inline const AssimpNodeData& GetRootNode() { return m_RootNode; }
 	inline const std::map<std::string,BoneInfo>& GetBoneIDMap() 
 	{ 
 		return m_BoneInfoMap;
 	}
+	/* hierarchy flattened in depth-first order, so parents always come before their children */
+	inline const std::vector<SkeletonNode>& GetSkeleton() const { return m_Skeleton; }
+	inline Bone& GetBone(int track) { return m_Bones[track]; }
+	inline const Bone& GetBone(int track) const { return m_Bones[track]; }
+	inline int GetBoneTrackCount() const { return static_cast<int>(m_Bones.size()); }
+	/* compresses the keys of every track, see Bone::Compress. Returns the totals for the whole clip */
+	KeyframeCompressionStats Compress(const KeyframeCompressionSettings& settings = KeyframeCompressionSettings())
+	{
+		KeyframeCompressionStats stats;
+		for (Bone& bone : m_Bones)
+			stats.Merge(bone.Compress(settings));
+		return stats;
+	}
+
+	/* bone tracks still sampled when nodes with a height below skeletonLod are skipped */
+	inline int GetTrackCountAtLod(int skeletonLod) const
+	{
+		if (m_TracksAtLod.empty())
+			return GetBoneTrackCount();
+		skeletonLod = std::max(0, skeletonLod);
+		return skeletonLod < static_cast<int>(m_TracksAtLod.size()) ? m_TracksAtLod[skeletonLod] : 0;
+	}
+
+	/* moves the root node's travel and turning out of the clip into a separate curve, making the clip play in place.
+	Every key of the root track is re-baked as P^-1 * M^-1 * P * L, where L is the old local transform, P the node's
+	(unanimated) parent and M the extracted motion, so model matrix * M(t) with the in-place pose gives the same final
+	pose as before at every key. A root track left constant is detached from the skeleton and no longer evaluated.
+	rootName defaults to the topmost animated node; height stays in the clip unless extractVertical.
+	Run before Compress. Returns false when there's no suitable root. */
+	bool ExtractRootMotion(const std::string& rootName = std::string(), bool extractVertical = false)
+	{
+		if (!m_RootMotion.empty())
+			return false;
+
+		int node = -1;
+		if (rootName.empty())
+		{
+			for (size_t i = 0; i < m_Skeleton.size() && node == -1; i++)
+				if (m_Skeleton[i].track != -1)
+					node = static_cast<int>(i);
+		}
+		else
+			node = FindSkeletonNode(rootName);
+		if (node == -1 || m_Skeleton[node].track == -1)
+			return false;
+
+		const int parent = m_Skeleton[node].parent;
+		Bone& bone = m_Bones[m_Skeleton[node].track];
+		if ((parent != -1 && m_Skeleton[parent].animated) || bone.IsCompressed())
+			return false;
+
+		const glm::mat4 parentGlobal = parent == -1 ? glm::mat4(1.0f) : AffineToMat4(m_Skeleton[parent].bindGlobal);
+		const glm::mat4 inverseParent = glm::inverse(parentGlobal);
+		const std::vector<float> times = bone.GetKeyTimes();
+		std::vector<glm::mat4> globals(times.size());
+		BoneCursor cursor;
+		for (size_t i = 0; i < times.size(); i++)
+			globals[i] = parentGlobal * bone.Sample(times[i], cursor);
+
+		// heading: whichever of the node's axes starts out closest to horizontal
+		int axis = 0;
+		float horizontal = -1.0f;
+		for (int a = 0; a < 3; a++)
+		{
+			const float length = glm::length(glm::vec2(globals[0][a].x, globals[0][a].z));
+			if (length > horizontal)
+			{
+				horizontal = length;
+				axis = a;
+			}
+		}
+
+		m_RootMotion.resize(times.size());
+		for (size_t i = 0; i < times.size(); i++)
+		{
+			RootMotionKey& key = m_RootMotion[i];
+			key.timeStamp = times[i];
+			key.translation = glm::vec3(globals[i][3]);
+			if (!extractVertical)
+				key.translation.y = 0.0f;
+			key.yaw = std::atan2(globals[i][axis].x, globals[i][axis].z);
+			if (i > 0)
+			{
+				const float previous = m_RootMotion[i - 1].yaw;
+				while (key.yaw - previous > glm::pi<float>())
+					key.yaw -= glm::two_pi<float>();
+				while (key.yaw - previous < -glm::pi<float>())
+					key.yaw += glm::two_pi<float>();
+			}
+		}
+
+		std::vector<KeyPosition> positions(times.size());
+		std::vector<KeyRotation> rotations(times.size());
+		std::vector<KeyScale> scales(times.size());
+		bool constant = true;
+		for (size_t i = 0; i < times.size(); i++)
+		{
+			const glm::mat4 local = inverseParent * glm::inverse(RootMotionTransform(m_RootMotion[i])) * globals[i];
+			glm::vec3 skew;
+			glm::vec4 perspective;
+			glm::decompose(local, scales[i].scale, rotations[i].orientation, positions[i].position, skew, perspective);
+			rotations[i].orientation = glm::normalize(rotations[i].orientation);
+			positions[i].timeStamp = rotations[i].timeStamp = scales[i].timeStamp = times[i];
+
+			constant = constant && glm::length(positions[i].position - positions[0].position) < 1e-4f &&
+				glm::length(scales[i].scale - scales[0].scale) < 1e-4f &&
+				std::abs(glm::dot(rotations[i].orientation, rotations[0].orientation)) > 1.0f - 1e-6f;
+		}
+
+		SkeletonNode& root = m_Skeleton[node];
+		if (constant)
+		{
+			root.track = -1;
+			root.bindTranslation = positions[0].position;
+			root.bindRotation = rotations[0].orientation;
+			root.bindScale = scales[0].scale;
+			root.transformation = AffineToMat4(ComposeAffine(root.bindTranslation, root.bindRotation, root.bindScale));
+			root.bindLocal = Mat4ToAffine(root.transformation);
+			for (size_t i = node; i < m_Skeleton.size(); i++)
+			{
+				SkeletonNode& flat = m_Skeleton[i];
+				const bool parentAnimated = flat.parent != -1 && m_Skeleton[flat.parent].animated;
+				flat.animated = flat.track != -1 || parentAnimated;
+				flat.bindGlobal = flat.parent == -1 ? flat.bindLocal : MultiplyAffine(m_Skeleton[flat.parent].bindGlobal, flat.bindLocal);
+			}
+			ComputeSkeletonHeights();
+		}
+		bone.SetKeys(std::move(positions), std::move(rotations), std::move(scales));
+		return true;
+	}
+
+	inline bool HasRootMotion() const { return !m_RootMotion.empty(); }
+	inline const std::vector<RootMotionKey>& GetRootMotion() const { return m_RootMotion; }
+
+	/* model space transform the clip has moved the character by at animationTime, identity at time 0 */
+	glm::mat4 SampleRootMotion(float animationTime) const
+	{
+		if (m_RootMotion.empty())
+			return glm::mat4(1.0f);
+		if (animationTime <= m_RootMotion.front().timeStamp || m_RootMotion.size() == 1)
+			return RootMotionTransform(m_RootMotion.front());
+		if (animationTime >= m_RootMotion.back().timeStamp)
+			return RootMotionTransform(m_RootMotion.back());
+
+		auto next = std::upper_bound(m_RootMotion.begin(), m_RootMotion.end(), animationTime,
+			[](float time, const RootMotionKey& key) { return time < key.timeStamp; });
+		const RootMotionKey& a = *(next - 1);
+		const RootMotionKey& b = *next;
+		const float factor = (animationTime - a.timeStamp) / (b.timeStamp - a.timeStamp);
+		RootMotionKey key;
+		key.timeStamp = animationTime;
+		key.translation = glm::mix(a.translation, b.translation, factor);
+		key.yaw = a.yaw + (b.yaw - a.yaw) * factor;
+		return RootMotionTransform(key);
+	}
+
+	/* motion between two times, to append to the model matrix. looped: toTime is in the next loop of the clip */
+	glm::mat4 GetRootMotionDelta(float fromTime, float toTime, bool looped) const
+	{
+		const glm::mat4 from = glm::inverse(SampleRootMotion(fromTime));
+		if (!looped)
+			return from * SampleRootMotion(toTime);
+		return from * SampleRootMotion(m_Duration) * SampleRootMotion(toTime);
+	}
+
+	inline const std::string& GetSkeletonNodeName(int node) const { return m_SkeletonNames[node]; }
+
+	/* index of the named node in GetSkeleton(), -1 if there is none */
+	int FindSkeletonNode(const std::string& name) const
+	{
+		for (size_t i = 0; i < m_SkeletonNames.size(); i++)
+			if (m_SkeletonNames[i] == name)
+				return static_cast<int>(i);
+		return -1;
+	}
 
 private:
 	void ReadMissingBones(const aiAnimation* animation, Model& model)
@@ -87,6 +320,108 @@ private:
 		m_BoneInfoMap = boneInfoMap;
 	}
 
+	void SaveCache(const std::string& cachePath, const std::string& animationPath) const
+	{
+		CacheWriter writer("LGAN", animationPath);
+		writer.write(m_Duration);
+		writer.write(static_cast<int32_t>(m_TicksPerSecond));
+		WriteHierarchy(writer, m_RootNode);
+		writer.write(static_cast<uint32_t>(m_Bones.size()));
+		for (const Bone& bone : m_Bones)
+		{
+			writer.writeString(bone.GetBoneName());
+			writer.write(static_cast<uint32_t>(bone.GetPositionKeys().size()));
+			writer.write(static_cast<uint32_t>(bone.GetRotationKeys().size()));
+			writer.write(static_cast<uint32_t>(bone.GetScaleKeys().size()));
+			writer.writeArray(bone.GetPositionKeys().data(), bone.GetPositionKeys().size());
+			writer.writeArray(bone.GetRotationKeys().data(), bone.GetRotationKeys().size());
+			writer.writeArray(bone.GetScaleKeys().data(), bone.GetScaleKeys().size());
+		}
+		writer.save(cachePath);
+	}
+
+	/* reads everything into locals first, so a stale or broken cache leaves both the animation and the model as
+	they were. Bones missing from the model are added the same way ReadMissingBones does */
+	bool LoadCache(const std::string& cachePath, const std::string& animationPath, Model& model)
+	{
+		CacheReader reader;
+		float duration;
+		int32_t ticksPerSecond;
+		uint32_t trackCount;
+		AssimpNodeData root;
+		if (!reader.open(cachePath, "LGAN", animationPath) || !reader.read(duration) || !reader.read(ticksPerSecond) ||
+			!ReadHierarchy(reader, root) || !reader.read(trackCount))
+			return false;
+
+		/* key arrays point into the mapped file until the Bones copy them */
+		struct CachedTrack
+		{
+			std::string name;
+			uint32_t positionCount, rotationCount, scaleCount;
+			const KeyPosition* positions;
+			const KeyRotation* rotations;
+			const KeyScale* scales;
+		};
+		std::vector<CachedTrack> tracks;
+		for (uint32_t i = 0; i < trackCount; i++)
+		{
+			CachedTrack track;
+			if (!reader.readString(track.name) || !reader.read(track.positionCount) || !reader.read(track.rotationCount) ||
+				!reader.read(track.scaleCount))
+				return false;
+			track.positions = reader.readArray<KeyPosition>(track.positionCount);
+			track.rotations = reader.readArray<KeyRotation>(track.rotationCount);
+			track.scales = reader.readArray<KeyScale>(track.scaleCount);
+			if (!track.positions || !track.rotations || !track.scales)
+				return false;
+			tracks.push_back(track);
+		}
+
+		auto& boneInfoMap = model.GetBoneInfoMap();
+		int& boneCount = model.GetBoneCount();
+		for (const CachedTrack& track : tracks)
+		{
+			if (boneInfoMap.find(track.name) == boneInfoMap.end())
+			{
+				boneInfoMap[track.name].id = boneCount;
+				boneCount++;
+			}
+			m_Bones.push_back(Bone(track.name, boneInfoMap[track.name].id,
+				std::vector<KeyPosition>(track.positions, track.positions + track.positionCount),
+				std::vector<KeyRotation>(track.rotations, track.rotations + track.rotationCount),
+				std::vector<KeyScale>(track.scales, track.scales + track.scaleCount)));
+		}
+		m_BoneInfoMap = boneInfoMap;
+		m_Duration = duration;
+		m_TicksPerSecond = ticksPerSecond;
+		m_RootNode = std::move(root);
+		return true;
+	}
+
+	static void WriteHierarchy(CacheWriter& writer, const AssimpNodeData& node)
+	{
+		writer.writeString(node.name);
+		writer.write(node.transformation);
+		writer.write(static_cast<uint32_t>(node.children.size()));
+		for (const AssimpNodeData& child : node.children)
+			WriteHierarchy(writer, child);
+	}
+
+	static bool ReadHierarchy(CacheReader& reader, AssimpNodeData& node)
+	{
+		uint32_t childCount;
+		if (!reader.readString(node.name) || !reader.read(node.transformation) || !reader.read(childCount))
+			return false;
+		node.childrenCount = static_cast<int>(childCount);
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			node.children.push_back(AssimpNodeData());
+			if (!ReadHierarchy(reader, node.children.back()))
+				return false;
+		}
+		return true;
+	}
+
 	void ReadHierarchyData(AssimpNodeData& dest, const aiNode* src)
 	{
 		assert(src);
@@ -102,10 +437,76 @@ private:
 			dest.children.push_back(newData);
 		}
 	}
+	void BuildSkeleton(const AssimpNodeData& node, int parent)
+	{
+		SkeletonNode flat;
+		flat.transformation = node.transformation;
+		flat.parent = parent;
+
+		glm::vec3 skew;
+		glm::vec4 perspective;
+		glm::decompose(node.transformation, flat.bindScale, flat.bindRotation, flat.bindTranslation, skew, perspective);
+		flat.bindRotation = glm::normalize(flat.bindRotation);
+
+		Bone* bone = FindBone(node.name);
+		flat.track = bone ? static_cast<int>(bone - &m_Bones[0]) : -1;
+		flat.height = 0;
+
+		auto boneInfo = m_BoneInfoMap.find(node.name);
+		flat.boneId = boneInfo != m_BoneInfoMap.end() ? boneInfo->second.id : -1;
+		flat.offset = boneInfo != m_BoneInfoMap.end() ? boneInfo->second.offset : glm::mat4(1.0f);
+
+		flat.bindLocal = Mat4ToAffine(flat.transformation);
+		flat.affineOffset = Mat4ToAffine(flat.offset);
+		flat.animated = flat.track != -1 || (parent != -1 && m_Skeleton[parent].animated);
+		flat.bindGlobal = parent == -1 ? flat.bindLocal : MultiplyAffine(m_Skeleton[parent].bindGlobal, flat.bindLocal);
+
+		const int index = static_cast<int>(m_Skeleton.size());
+		m_Skeleton.push_back(flat);
+		m_SkeletonNames.push_back(node.name);
+		for (int i = 0; i < node.childrenCount; i++)
+			BuildSkeleton(node.children[i], index);
+	}
+
+	/* children come after their parent, so walking backwards finishes every subtree before its root */
+	void ComputeSkeletonHeights()
+	{
+		int maxHeight = 0;
+		for (int i = static_cast<int>(m_Skeleton.size()) - 1; i >= 0; i--)
+		{
+			const SkeletonNode& node = m_Skeleton[i];
+			if (node.parent != -1)
+				m_Skeleton[node.parent].height = std::max(m_Skeleton[node.parent].height, node.height + 1);
+			maxHeight = std::max(maxHeight, node.height);
+		}
+
+		m_TracksAtLod.assign(maxHeight + 2, 0);
+		for (const SkeletonNode& node : m_Skeleton)
+			if (node.track != -1)
+				for (int lod = 0; lod <= node.height; lod++)
+					m_TracksAtLod[lod]++;
+	}
+
+	/* turns by the yaw change since the first key about the first key's position, then moves to the key's position */
+	glm::mat4 RootMotionTransform(const RootMotionKey& key) const
+	{
+		const RootMotionKey& first = m_RootMotion.front();
+		return glm::translate(glm::mat4(1.0f), key.translation) *
+			glm::rotate(glm::mat4(1.0f), key.yaw - first.yaw, glm::vec3(0.0f, 1.0f, 0.0f)) *
+			glm::translate(glm::mat4(1.0f), -first.translation);
+	}
+
 	float m_Duration;
 	int m_TicksPerSecond;
 	std::vector<Bone> m_Bones;
 	AssimpNodeData m_RootNode;
 	std::map<std::string, BoneInfo> m_BoneInfoMap;
+	std::vector<SkeletonNode> m_Skeleton;
+	/* kept apart from m_Skeleton so the per-frame pass doesn't drag strings through the cache */
+	std::vector<std::string> m_SkeletonNames;
+	/* m_TracksAtLod[lod] = tracks on nodes of height >= lod */
+	std::vector<int> m_TracksAtLod;
+	/* extracted root motion curve, empty unless ExtractRootMotion ran */
+	std::vector<RootMotionKey> m_RootMotion;
 };
 
@@ -0,0 +1,137 @@
+#pragma once
+
+/* Picks an animation LOD per character from its on-screen size and keeps the frame's bone evaluations in budget */
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <learnopengl/animator.h>
+#include <learnopengl/camera.h>
+#include <learnopengl/entity.h>
+#include <learnopengl/thread_pool.h>
+
+/* one level of detail. A character uses the first level whose minScreenSize its projected size reaches */
+struct AnimationLodLevel
+{
+	/* bounding sphere diameter over viewport height */
+	float minScreenSize;
+	/* evaluate every Nth frame, interpolating in between */
+	int updateInterval;
+	/* skip skeleton nodes with a height below this, see SkeletonNode::height */
+	int skeletonLod;
+};
+
+class AnimationLodSystem
+{
+public:
+	/* ordered from the most detailed level down; the last one catches everything smaller */
+	std::vector<AnimationLodLevel> levels;
+
+	/* cap on bone tracks sampled per frame, averaged over the update intervals; 0 for no cap */
+	int boneBudget = 0;
+
+	/* bone tracks actually sampled by the last Update */
+	int boneEvaluations = 0;
+
+	AnimationLodSystem()
+	{
+		levels.push_back({ 0.25f, 1, 0 });
+		levels.push_back({ 0.08f, 2, 1 });
+		levels.push_back({ 0.02f, 4, 2 });
+		levels.push_back({ 0.0f, 8, 3 });
+	}
+
+	/* fraction of the viewport height covered by the bounds' sphere, seen from cameraPosition with vertical fov fovY
+	(radians). 1 or more when the camera is inside */
+	static float ProjectedSize(const AABB& bounds, const glm::vec3& cameraPosition, float fovY)
+	{
+		const float radius = glm::length(bounds.extents);
+		const float distance = glm::length(bounds.center - cameraPosition);
+		if (distance <= radius)
+			return 1.0f;
+		return radius / (distance * std::tan(fovY * 0.5f));
+	}
+
+	/* chooses a level for every animator from its bounds (e.g. Entity::getGlobalAABB()), pushes the least visible ones
+	to coarser levels until the budget holds, then updates them all across the pool */
+	void Update(const std::vector<Animator*>& animators, const std::vector<AABB>& bounds, const glm::vec3& cameraPosition,
+		float fovY, float dt, ThreadPool& pool)
+	{
+		const size_t count = animators.size();
+		m_Order.resize(count);
+		m_ScreenSize.resize(count);
+		m_Level.resize(count);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			m_Order[i] = static_cast<unsigned int>(i);
+			m_ScreenSize[i] = ProjectedSize(bounds[i], cameraPosition, fovY);
+			m_Level[i] = LevelFor(m_ScreenSize[i]);
+		}
+
+		if (boneBudget > 0 && !levels.empty())
+			FitBudget(animators);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const AnimationLodLevel& level = levels[m_Level[i]];
+			animators[i]->SetLod(level.updateInterval, level.skeletonLod, static_cast<int>(i));
+		}
+
+		Animator::UpdateAnimations(animators, dt, pool);
+
+		boneEvaluations = 0;
+		for (size_t i = 0; i < count; i++)
+			boneEvaluations += animators[i]->GetBoneEvaluations();
+	}
+
+	/* same, seen from the camera, with Zoom as its vertical field of view */
+	void Update(const std::vector<Animator*>& animators, const std::vector<AABB>& bounds, const Camera& camera, float dt,
+		ThreadPool& pool)
+	{
+		Update(animators, bounds, camera.Position, glm::radians(camera.Zoom), dt, pool);
+	}
+
+private:
+	std::vector<unsigned int> m_Order;
+	std::vector<float> m_ScreenSize;
+	std::vector<int> m_Level;
+
+	int LevelFor(float screenSize) const
+	{
+		for (size_t level = 0; level < levels.size(); level++)
+			if (screenSize >= levels[level].minScreenSize)
+				return static_cast<int>(level);
+		return levels.empty() ? 0 : static_cast<int>(levels.size()) - 1;
+	}
+
+	/* tracks one frame costs on average at a level */
+	float Cost(const Animator& animator, int level) const
+	{
+		return static_cast<float>(animator.GetEvaluationCost(levels[level].skeletonLod)) / levels[level].updateInterval;
+	}
+
+	/* coarsens the characters smallest on screen first, each as far as it goes, until the expected cost fits */
+	void FitBudget(const std::vector<Animator*>& animators)
+	{
+		float total = 0.0f;
+		for (size_t i = 0; i < animators.size(); i++)
+			total += Cost(*animators[i], m_Level[i]);
+
+		std::sort(m_Order.begin(), m_Order.end(),
+			[this](unsigned int a, unsigned int b) { return m_ScreenSize[a] < m_ScreenSize[b]; });
+
+		const int coarsest = static_cast<int>(levels.size()) - 1;
+		for (size_t k = 0; k < m_Order.size() && total > boneBudget; k++)
+		{
+			const unsigned int i = m_Order[k];
+			while (m_Level[i] < coarsest && total > boneBudget)
+			{
+				total -= Cost(*animators[i], m_Level[i]);
+				m_Level[i]++;
+				total += Cost(*animators[i], m_Level[i]);
+			}
+		}
+	}
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+/* Local-space poses and the operations that blend them */
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <learnopengl/animation.h>
+
+/* local transform of every skeleton node, one array per channel so blending runs down plain float arrays */
+struct LocalPose
+{
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+
+	size_t size() const { return translations.size(); }
+
+	void resize(size_t count)
+	{
+		translations.resize(count);
+		rotations.resize(count);
+		scales.resize(count);
+	}
+};
+
+/* how a layer combines with the pose below it */
+enum class BlendMode
+{
+	Override,	/* moves the pose towards the layer's pose */
+	Additive	/* adds the layer's motion relative to its first frame on top of the pose */
+};
+
+/* per skeleton node weight in [0, 1]. An empty mask lets every node through */
+typedef std::vector<float> BoneMask;
+
+/* samples every node of the animation's skeleton at animationTime. Nodes without a track, or with a height below
+skeletonLod, keep their bind transform. Returns the number of tracks sampled */
+inline int SamplePose(const Animation& animation, float animationTime, std::vector<BoneCursor>& cursors, LocalPose& pose,
+	int skeletonLod = 0)
+{
+	const std::vector<SkeletonNode>& skeleton = animation.GetSkeleton();
+	pose.resize(skeleton.size());
+	int sampled = 0;
+
+	for (size_t i = 0; i < skeleton.size(); i++)
+	{
+		const SkeletonNode& node = skeleton[i];
+		if (node.track != -1 && node.height >= skeletonLod)
+		{
+			animation.GetBone(node.track).SampleTRS(animationTime, cursors[node.track],
+				pose.translations[i], pose.rotations[i], pose.scales[i]);
+			sampled++;
+		}
+		else
+		{
+			pose.translations[i] = node.bindTranslation;
+			pose.rotations[i] = node.bindRotation;
+			pose.scales[i] = node.bindScale;
+		}
+	}
+	return sampled;
+}
+
+/* normalized lerp on the shorter arc. Close enough to slerp for the small angles between blended poses, and cheap */
+inline glm::quat NlerpShortest(const glm::quat& from, const glm::quat& to, float weight)
+{
+	const float sign = glm::dot(from, to) < 0.0f ? -1.0f : 1.0f;
+	glm::quat result;
+	result.x = from.x + (to.x * sign - from.x) * weight;
+	result.y = from.y + (to.y * sign - from.y) * weight;
+	result.z = from.z + (to.z * sign - from.z) * weight;
+	result.w = from.w + (to.w * sign - from.w) * weight;
+	return glm::normalize(result);
+}
+
+/* pose = mix(pose, target, weight * mask[i]). Both poses must come from the same skeleton */
+inline void BlendPose(LocalPose& pose, const LocalPose& target, float weight, const BoneMask& mask)
+{
+	const size_t count = std::min(pose.size(), target.size());
+	const bool masked = !mask.empty();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const float w = masked ? weight * mask[i] : weight;
+		pose.translations[i] += (target.translations[i] - pose.translations[i]) * w;
+		pose.scales[i] += (target.scales[i] - pose.scales[i]) * w;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		const float w = masked ? weight * mask[i] : weight;
+		pose.rotations[i] = NlerpShortest(pose.rotations[i], target.rotations[i], w);
+	}
+}
+
+/* applies the difference between layer and reference on top of pose, scaled by weight * mask[i]. Nodes of animation's
+skeleton with a height below skeletonLod were left at bind by SamplePose while the reference still moved them, so
+they're left alone instead of picking up bind - reference as an offset */
+inline void AddPose(LocalPose& pose, const LocalPose& layer, const LocalPose& reference, float weight, const BoneMask& mask,
+	const Animation& animation, int skeletonLod = 0)
+{
+	const std::vector<SkeletonNode>& skeleton = animation.GetSkeleton();
+	const size_t count = std::min(std::min(pose.size(), skeleton.size()), std::min(layer.size(), reference.size()));
+	const bool masked = !mask.empty();
+	const glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (skeleton[i].height < skeletonLod)
+			continue;
+		const float w = masked ? weight * mask[i] : weight;
+		pose.translations[i] += (layer.translations[i] - reference.translations[i]) * w;
+		pose.scales[i] *= glm::mix(glm::vec3(1.0f), layer.scales[i] / reference.scales[i], w);
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		if (skeleton[i].height < skeletonLod)
+			continue;
+		const float w = masked ? weight * mask[i] : weight;
+		const glm::quat delta = glm::inverse(reference.rotations[i]) * layer.rotations[i];
+		pose.rotations[i] = glm::normalize(pose.rotations[i] * NlerpShortest(identity, delta, w));
+	}
+}
+
+/* mask with weight on the named node and everything below it, 0 elsewhere (everywhere if there's no such node) */
+inline BoneMask BuildBoneMask(const Animation& animation, const std::string& rootName, float weight = 1.0f)
+{
+	const std::vector<SkeletonNode>& skeleton = animation.GetSkeleton();
+	BoneMask mask(skeleton.size(), 0.0f);
+	const int root = animation.FindSkeletonNode(rootName);
+	if (root == -1)
+		return mask;
+
+	mask[root] = weight;
+	// parents come first, so a node is in the subtree exactly when its parent already is
+	for (size_t i = root + 1; i < skeleton.size(); i++)
+		if (skeleton[i].parent >= root && mask[skeleton[i].parent] != 0.0f)
+			mask[i] = weight;
+	return mask;
+}
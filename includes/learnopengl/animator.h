@@ -6,37 +6,238 @@
 #include <assimp/scene.h>
 #include <assimp/Importer.hpp>
 #include <learnopengl/animation.h>
+#include <learnopengl/animation_pose.h>
 #include <learnopengl/bone.h>
+#include <learnopengl/thread_pool.h>
 
+/* Animation, its Bones and skeleton are only read while playing; every bit of playback state (time, key cursors,
+poses) lives in the Animator. So any number of Animators can play the same Animation, on any thread. */
 class Animator
 {
 public:
+	/* animators handed to one task by UpdateAnimations */
+	static const size_t UPDATE_BATCH_SIZE = 8;
+
 	Animator(Animation* animation)
 	{
 		m_CurrentTime = 0.0;
 		m_CurrentAnimation = animation;
+		m_PreviousAnimation = nullptr;
+		m_PreviousTime = 0.0f;
+		m_FadeDuration = 0.0f;
+		m_FadeTime = 0.0f;
+		m_UpdateInterval = 1;
+		m_FrameInInterval = 0;
+		m_SkeletonLod = 0;
+		m_BoneEvaluations = 0;
+		m_RootMotionTime = 0.0f;
+		m_RootMotionDelta = glm::mat4(1.0f);
+		ResetCursors();
 
 		m_FinalBoneMatrices.reserve(100);
 
 		for (int i = 0; i < 100; i++)
 			m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
+		m_AffinePalette.assign(m_FinalBoneMatrices.size(), IdentityAffine());
 	}
 
 	void UpdateAnimation(float dt)
 	{
 		m_DeltaTime = dt;
-		if (m_CurrentAnimation)
+		m_BoneEvaluations = 0;
+		if (!m_CurrentAnimation)
+			return;
+		AdvanceRootMotion(dt);
+
+		if (m_UpdateInterval <= 1)
+		{
+			AdvanceTime(dt);
+			EvaluatePalette();
+			return;
+		}
+
+		/* decimated: evaluate once per interval, one whole interval ahead, and show the frames in between by
+		interpolating from the previous evaluation. Matrices are lerped, fine for the small motion of one interval */
+		if (m_FrameInInterval == 0)
+		{
+			m_PreviousPalette.swap(m_TargetPalette);
+			AdvanceTime(dt * m_UpdateInterval);
+			EvaluatePalette();
+			m_TargetPalette = m_AffinePalette;
+		}
+		m_FrameInInterval++;
+		const float factor = static_cast<float>(m_FrameInInterval) / m_UpdateInterval;
+		for (size_t i = 0; i < m_AffinePalette.size(); i++)
+			WritePalette(static_cast<int>(i), MixAffine(m_PreviousPalette[i], m_TargetPalette[i], factor));
+		if (m_FrameInInterval >= m_UpdateInterval)
+			m_FrameInInterval = 0;
+	}
+
+	/* animation LOD. updateInterval: evaluate every Nth update and interpolate in between. skeletonLod: leave skeleton
+	nodes with a height below it (leaves such as fingers and face first) at their bind transform. phase spreads
+	animators with the same interval over different frames */
+	void SetLod(int updateInterval, int skeletonLod, int phase = 0)
+	{
+		updateInterval = std::max(1, updateInterval);
+		if (updateInterval != m_UpdateInterval)
 		{
-			m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
-			m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
-			CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+			m_UpdateInterval = updateInterval;
+			m_FrameInInterval = updateInterval > 1 ? phase % updateInterval : 0;
+			m_PreviousPalette = m_AffinePalette;
+			m_TargetPalette = m_AffinePalette;
 		}
+		m_SkeletonLod = std::max(0, skeletonLod);
+	}
+
+	int GetUpdateInterval() const { return m_UpdateInterval; }
+	int GetSkeletonLod() const { return m_SkeletonLod; }
+
+	/* bone tracks sampled by the last UpdateAnimation, 0 on frames decimation skipped */
+	int GetBoneEvaluations() const { return m_BoneEvaluations; }
+
+	/* bone tracks a full evaluation at the given skeleton LOD samples, counting every clip being blended */
+	int GetEvaluationCost(int skeletonLod) const
+	{
+		if (!m_CurrentAnimation)
+			return 0;
+		int cost = m_CurrentAnimation->GetTrackCountAtLod(skeletonLod);
+		if (m_PreviousAnimation)
+			cost += m_PreviousAnimation->GetTrackCountAtLod(skeletonLod);
+		for (const AnimationLayer& layer : m_Layers)
+			if (layer.weight > 0.0f)
+				cost += layer.clip->GetTrackCountAtLod(skeletonLod);
+		return cost;
 	}
 
 	void PlayAnimation(Animation* pAnimation)
 	{
 		m_CurrentAnimation = pAnimation;
 		m_CurrentTime = 0.0f;
+		m_RootMotionTime = 0.0f;
+		m_PreviousAnimation = nullptr;
+		ResetCursors();
+	}
+
+	/* switches to pAnimation, blending out of the current one over duration seconds instead of popping.
+	Both animations must share the skeleton. Fading again mid-fade starts from the newer of the two clips. */
+	void CrossFade(Animation* pAnimation, float duration)
+	{
+		if (!m_CurrentAnimation || duration <= 0.0f)
+		{
+			PlayAnimation(pAnimation);
+			return;
+		}
+
+		m_PreviousAnimation = m_CurrentAnimation;
+		m_PreviousTime = m_CurrentTime;
+		m_PreviousCursors.swap(m_Cursors);
+		m_FadeDuration = duration;
+		m_FadeTime = 0.0f;
+
+		m_CurrentAnimation = pAnimation;
+		m_CurrentTime = 0.0f;
+		m_RootMotionTime = 0.0f;
+		ResetCursors();
+	}
+
+	/* plays clip on top of the base animation, restricted to the nodes of mask (empty = whole skeleton).
+	An additive layer adds its motion relative to its first frame. Returns the layer index for SetLayerWeight */
+	int AddLayer(Animation* clip, BlendMode mode, float weight, const BoneMask& mask = BoneMask())
+	{
+		AnimationLayer layer;
+		layer.clip = clip;
+		layer.mode = mode;
+		layer.weight = weight;
+		layer.time = 0.0f;
+		layer.mask = mask;
+		layer.cursors.assign(clip->GetBoneTrackCount(), BoneCursor());
+		if (mode == BlendMode::Additive)
+		{
+			std::vector<BoneCursor> cursors(clip->GetBoneTrackCount());
+			SamplePose(*clip, 0.0f, cursors, layer.reference);
+		}
+		m_Layers.push_back(std::move(layer));
+		return static_cast<int>(m_Layers.size() - 1);
+	}
+
+	void SetLayerWeight(int layer, float weight) { m_Layers[layer].weight = weight; }
+	void ClearLayers() { m_Layers.clear(); }
+
+	/* advances every animator by dt, spread across the pool. Animators may share Animations */
+	static void UpdateAnimations(const std::vector<Animator*>& animators, float dt, ThreadPool& pool)
+	{
+		pool.parallelFor(0, animators.size(), UPDATE_BATCH_SIZE, [&animators, dt](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+					animators[i]->UpdateAnimation(dt);
+			});
+	}
+
+	/* evaluates the flattened skeleton in one pass: parents come first, so their global transform is always ready */
+	void CalculateBoneTransforms()
+	{
+		const std::vector<SkeletonNode>& skeleton = m_CurrentAnimation->GetSkeleton();
+		m_GlobalTransforms.resize(skeleton.size());
+
+		for (size_t i = 0; i < skeleton.size(); i++)
+		{
+			const SkeletonNode& node = skeleton[i];
+			if (!node.animated)
+				m_GlobalTransforms[i] = node.bindGlobal;
+			else
+			{
+				AffineTransform nodeTransform = node.bindLocal;
+
+				if (node.track != -1 && node.height >= m_SkeletonLod)
+				{
+					nodeTransform = m_CurrentAnimation->GetBone(node.track).SampleAffine(m_CurrentTime, m_Cursors[node.track]);
+					m_BoneEvaluations++;
+				}
+
+				m_GlobalTransforms[i] = node.parent == -1 ? nodeTransform : MultiplyAffine(m_GlobalTransforms[node.parent], nodeTransform);
+			}
+
+			if (node.boneId != -1 && node.boneId < static_cast<int>(m_AffinePalette.size()))
+				WritePalette(node.boneId, MultiplyAffine(m_GlobalTransforms[i], node.affineOffset));
+		}
+	}
+
+	/* same pass over local TRS poses: one sample per clip, then every blend is a linear sweep over the arrays */
+	void CalculateBlendedBoneTransforms()
+	{
+		if (m_PreviousAnimation)
+		{
+			m_BoneEvaluations += SamplePose(*m_PreviousAnimation, m_PreviousTime, m_PreviousCursors, m_Pose, m_SkeletonLod);
+			m_BoneEvaluations += SamplePose(*m_CurrentAnimation, m_CurrentTime, m_Cursors, m_LayerPose, m_SkeletonLod);
+			BlendPose(m_Pose, m_LayerPose, m_FadeTime / m_FadeDuration, BoneMask());
+		}
+		else
+			m_BoneEvaluations += SamplePose(*m_CurrentAnimation, m_CurrentTime, m_Cursors, m_Pose, m_SkeletonLod);
+
+		for (AnimationLayer& layer : m_Layers)
+		{
+			if (layer.weight <= 0.0f)
+				continue;
+			m_BoneEvaluations += SamplePose(*layer.clip, layer.time, layer.cursors, m_LayerPose, m_SkeletonLod);
+			if (layer.mode == BlendMode::Additive)
+				AddPose(m_Pose, m_LayerPose, layer.reference, layer.weight, layer.mask, *layer.clip, m_SkeletonLod);
+			else
+				BlendPose(m_Pose, m_LayerPose, layer.weight, layer.mask);
+		}
+
+		const std::vector<SkeletonNode>& skeleton = m_CurrentAnimation->GetSkeleton();
+		m_GlobalTransforms.resize(skeleton.size());
+
+		for (size_t i = 0; i < skeleton.size(); i++)
+		{
+			const SkeletonNode& node = skeleton[i];
+			const AffineTransform nodeTransform = ComposeAffine(m_Pose.translations[i], m_Pose.rotations[i], m_Pose.scales[i]);
+
+			m_GlobalTransforms[i] = node.parent == -1 ? nodeTransform : MultiplyAffine(m_GlobalTransforms[node.parent], nodeTransform);
+
+			if (node.boneId != -1 && node.boneId < static_cast<int>(m_AffinePalette.size()))
+				WritePalette(node.boneId, MultiplyAffine(m_GlobalTransforms[i], node.affineOffset));
+		}
 	}
 
 	void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
@@ -48,33 +249,151 @@ public:
 
 		if (Bone)
 		{
-			Bone->Update(m_CurrentTime);
-			nodeTransform = Bone->GetLocalTransform();
+			int track = static_cast<int>(Bone - &m_CurrentAnimation->GetBone(0));
+			nodeTransform = Bone->Sample(m_CurrentTime, m_Cursors[track]);
 		}
 
 		glm::mat4 globalTransformation = parentTransform * nodeTransform;
 
-		auto boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end())
+		auto& boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
+		auto boneInfo = boneInfoMap.find(nodeName);
+		if (boneInfo != boneInfoMap.end())
 		{
-			int index = boneInfoMap[nodeName].id;
-			glm::mat4 offset = boneInfoMap[nodeName].offset;
-			m_FinalBoneMatrices[index] = globalTransformation * offset;
+			int index = boneInfo->second.id;
+			glm::mat4 offset = boneInfo->second.offset;
+			WritePalette(index, Mat4ToAffine(globalTransformation * offset));
 		}
 
 		for (int i = 0; i < node->childrenCount; i++)
 			CalculateBoneTransform(&node->children[i], globalTransformation);
 	}
 
-	std::vector<glm::mat4> GetFinalBoneMatrices()
+	/* by reference: valid until the next update, copy it if it has to outlive that */
+	const std::vector<glm::mat4>& GetFinalBoneMatrices() const
 	{
 		return m_FinalBoneMatrices;
 	}
 
+	/* model space motion of the current clip's extracted root motion (Animation::ExtractRootMotion) over the last
+	UpdateAnimation, identity without any. Apply as model = model * GetRootMotionDelta(). Advances every frame, at full
+	rate even while decimated; a clip fading out contributes none */
+	const glm::mat4& GetRootMotionDelta() const
+	{
+		return m_RootMotionDelta;
+	}
+
+	/* the same palette as three affine rows per bone: 25% less to upload, see AffineTransform */
+	const std::vector<AffineTransform>& GetAffineBoneMatrices() const
+	{
+		return m_AffinePalette;
+	}
+
 private:
+	/* steps the root motion clock of the current clip by dt seconds and keeps the motion covered as m_RootMotionDelta,
+	including the wrap when the clip loops */
+	void AdvanceRootMotion(float dt)
+	{
+		if (!m_CurrentAnimation->HasRootMotion())
+		{
+			m_RootMotionDelta = glm::mat4(1.0f);
+			return;
+		}
+		const float duration = m_CurrentAnimation->GetDuration();
+		const float next = m_RootMotionTime + m_CurrentAnimation->GetTicksPerSecond() * dt;
+		const float wrapped = fmod(next, duration);
+		m_RootMotionDelta = m_CurrentAnimation->GetRootMotionDelta(m_RootMotionTime, wrapped, next >= duration);
+		m_RootMotionTime = wrapped;
+	}
+
+	/* moves every clip being played forward by dt seconds */
+	void AdvanceTime(float dt)
+	{
+		m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
+		m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
+
+		if (m_PreviousAnimation)
+		{
+			m_FadeTime += dt;
+			if (m_FadeTime >= m_FadeDuration)
+				m_PreviousAnimation = nullptr;
+			else
+			{
+				m_PreviousTime += m_PreviousAnimation->GetTicksPerSecond() * dt;
+				m_PreviousTime = fmod(m_PreviousTime, m_PreviousAnimation->GetDuration());
+			}
+		}
+		for (AnimationLayer& layer : m_Layers)
+		{
+			layer.time += layer.clip->GetTicksPerSecond() * dt;
+			layer.time = fmod(layer.time, layer.clip->GetDuration());
+		}
+	}
+
+	void WritePalette(int boneId, const AffineTransform& transform)
+	{
+		m_AffinePalette[boneId] = transform;
+		m_FinalBoneMatrices[boneId] = AffineToMat4(transform);
+	}
+
+	void EvaluatePalette()
+	{
+		if (m_PreviousAnimation || !m_Layers.empty())
+			CalculateBlendedBoneTransforms();
+		else
+			CalculateBoneTransforms();
+	}
+
+	struct AnimationLayer
+	{
+		Animation* clip;
+		BlendMode mode;
+		float weight;
+		float time;
+		BoneMask mask;
+		std::vector<BoneCursor> cursors;
+		/* first frame of an additive clip, what its motion is measured against */
+		LocalPose reference;
+	};
+
+	void ResetCursors()
+	{
+		m_Cursors.assign(m_CurrentAnimation ? m_CurrentAnimation->GetBoneTrackCount() : 0, BoneCursor());
+	}
+
 	std::vector<glm::mat4> m_FinalBoneMatrices;
+	/* the palette as computed; m_FinalBoneMatrices is its 4x4 copy */
+	std::vector<AffineTransform> m_AffinePalette;
+	/* key segment of every bone track of the current animation */
+	std::vector<BoneCursor> m_Cursors;
+	/* global transform of every skeleton node, reused from frame to frame */
+	std::vector<AffineTransform> m_GlobalTransforms;
 	Animation* m_CurrentAnimation;
 	float m_CurrentTime;
 	float m_DeltaTime;
 
+	/* clip being faded out, nullptr when no cross-fade is running */
+	Animation* m_PreviousAnimation;
+	float m_PreviousTime;
+	std::vector<BoneCursor> m_PreviousCursors;
+	float m_FadeDuration;
+	float m_FadeTime;
+
+	/* root motion runs on its own clock so decimated updates still move the character every frame */
+	float m_RootMotionTime;
+	glm::mat4 m_RootMotionDelta;
+
+	std::vector<AnimationLayer> m_Layers;
+	/* blended pose and scratch pose for each clip sampled into it, reused from frame to frame */
+	LocalPose m_Pose;
+	LocalPose m_LayerPose;
+
+	/* animation LOD, see SetLod */
+	int m_UpdateInterval;
+	int m_FrameInInterval;
+	int m_SkeletonLod;
+	/* palettes a decimated animator interpolates between */
+	std::vector<AffineTransform> m_PreviousPalette;
+	std::vector<AffineTransform> m_TargetPalette;
+	int m_BoneEvaluations;
+
 };
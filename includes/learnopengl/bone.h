@@ -5,10 +5,13 @@
 #include <vector>
 #include <assimp/scene.h>
 #include <list>
+#include <algorithm>
 #include <glm/glm.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
 #include <learnopengl/assimp_glm_helpers.h>
+#include <learnopengl/keyframe_compression.h>
+#include <learnopengl/affine_transform.h>
 
 struct KeyPosition
 {
@@ -28,6 +31,15 @@ struct KeyScale
 	float timeStamp;
 };
 
+/* key segment each track of a Bone was last sampled in. Kept by whoever plays the animation, so several
+characters can sample the same Bone at different times, from different threads */
+struct BoneCursor
+{
+	int position = 0;
+	int rotation = 0;
+	int scale = 0;
+};
+
 class Bone
 {
 public:
@@ -35,7 +47,8 @@ public:
 		:
 		m_Name(name),
 		m_ID(ID),
-		m_LocalTransform(1.0f)
+		m_LocalTransform(1.0f),
+		m_Compressed(false)
 	{
 		m_NumPositions = channel->mNumPositionKeys;
 
@@ -71,14 +84,171 @@ public:
 			m_Scales.push_back(data);
 		}
 	}
+
+	/*keys already converted, e.g. read back from an animation cache*/
+	Bone(const std::string& name, int ID, std::vector<KeyPosition> positions, std::vector<KeyRotation> rotations,
+		std::vector<KeyScale> scales)
+		:
+		m_LocalTransform(1.0f),
+		m_Name(name),
+		m_ID(ID),
+		m_Compressed(false)
+	{
+		m_Positions = std::move(positions);
+		m_Rotations = std::move(rotations);
+		m_Scales = std::move(scales);
+		m_NumPositions = static_cast<int>(m_Positions.size());
+		m_NumRotations = static_cast<int>(m_Rotations.size());
+		m_NumScalings = static_cast<int>(m_Scales.size());
+	}
+
+	/*source keys of the track, empty once compressed*/
+	inline const std::vector<KeyPosition>& GetPositionKeys() const { return m_Positions; }
+	inline const std::vector<KeyRotation>& GetRotationKeys() const { return m_Rotations; }
+	inline const std::vector<KeyScale>& GetScaleKeys() const { return m_Scales; }
 	
 	void Update(float animationTime)
 	{
-		glm::mat4 translation = InterpolatePosition(animationTime);
-		glm::mat4 rotation = InterpolateRotation(animationTime);
-		glm::mat4 scale = InterpolateScaling(animationTime);
-		m_LocalTransform = translation * rotation * scale;
+		m_LocalTransform = Sample(animationTime, m_Cursor);
+	}
+
+	/* local transform at animationTime. Only reads the bone, all playback state lives in cursor */
+	glm::mat4 Sample(float animationTime, BoneCursor& cursor) const
+	{
+		return AffineToMat4(SampleAffine(animationTime, cursor));
+	}
+
+	/* same transform composed straight into affine rows, see ComposeAffine */
+	AffineTransform SampleAffine(float animationTime, BoneCursor& cursor) const
+	{
+		return ComposeAffine(InterpolatePosition(animationTime, cursor.position),
+			InterpolateRotation(animationTime, cursor.rotation), InterpolateScaling(animationTime, cursor.scale));
+	}
+
+	/* same as Sample, but keeps translation, rotation and scale apart so poses can be blended before composing */
+	void SampleTRS(float animationTime, BoneCursor& cursor, glm::vec3& translation, glm::quat& rotation, glm::vec3& scale) const
+	{
+		translation = InterpolatePosition(animationTime, cursor.position);
+		rotation = InterpolateRotation(animationTime, cursor.rotation);
+		scale = InterpolateScaling(animationTime, cursor.scale);
+	}
+
+	/* replaces the keys with a reduced, quantized copy that sampling decodes on the fly: tracks that stay within
+	tolerance of their first key keep only that key, keys interpolation rebuilds within tolerance are dropped,
+	translations and scales are stored in 16 bits per axis across their track's range and rotations as 48 bit
+	smallest three. Cursors stay valid. Returns the memory saved and the largest error at the original key times */
+	KeyframeCompressionStats Compress(const KeyframeCompressionSettings& settings)
+	{
+		KeyframeCompressionStats stats;
+		if (m_Compressed)
+			return stats;
+
+		stats.keysBefore = m_Positions.size() + m_Rotations.size() + m_Scales.size();
+		stats.bytesBefore = m_Positions.size() * sizeof(KeyPosition) + m_Rotations.size() * sizeof(KeyRotation) +
+			m_Scales.size() * sizeof(KeyScale);
+
+		std::vector<float> times;
+		std::vector<glm::vec3> vectors;
+		for (const KeyPosition& key : m_Positions)
+		{
+			times.push_back(key.timeStamp);
+			vectors.push_back(key.position);
+		}
+		m_PackedPositions = PackTrack(times, vectors, settings.translationTolerance, m_PositionRange,
+			[](const glm::vec3& a, const glm::vec3& b) { return glm::length(a - b); });
+
+		times.clear();
+		vectors.clear();
+		for (const KeyScale& key : m_Scales)
+		{
+			times.push_back(key.timeStamp);
+			vectors.push_back(key.scale);
+		}
+		m_PackedScales = PackTrack(times, vectors, settings.scaleTolerance, m_ScaleRange, MaxAxisDifference);
+
+		times.clear();
+		std::vector<glm::quat> rotations;
+		for (const KeyRotation& key : m_Rotations)
+		{
+			times.push_back(key.timeStamp);
+			rotations.push_back(key.orientation);
+		}
+		std::vector<int> kept = ReduceKeys(times, rotations, settings.rotationTolerance,
+			[](const glm::quat& a, const glm::quat& b, float factor) { return glm::normalize(glm::slerp(a, b, factor)); },
+			QuatAngle);
+		m_PackedRotations.resize(kept.size());
+		for (size_t i = 0; i < kept.size(); i++)
+		{
+			EncodeQuat(rotations[kept[i]], m_PackedRotations[i].value);
+			m_PackedRotations[i].timeStamp = times[kept[i]];
+		}
+
+		m_Compressed = true;
+		m_NumPositions = static_cast<int>(m_PackedPositions.size());
+		m_NumRotations = static_cast<int>(m_PackedRotations.size());
+		m_NumScalings = static_cast<int>(m_PackedScales.size());
+
+		// compare what sampling now returns with the keys it replaced
+		int cursor = 0;
+		for (const KeyPosition& key : m_Positions)
+			stats.maxTranslationError = std::max(stats.maxTranslationError,
+				glm::length(InterpolatePosition(key.timeStamp, cursor) - key.position));
+		cursor = 0;
+		for (const KeyRotation& key : m_Rotations)
+			stats.maxRotationError = std::max(stats.maxRotationError,
+				QuatAngle(InterpolateRotation(key.timeStamp, cursor), key.orientation));
+		cursor = 0;
+		for (const KeyScale& key : m_Scales)
+			stats.maxScaleError = std::max(stats.maxScaleError,
+				MaxAxisDifference(InterpolateScaling(key.timeStamp, cursor), key.scale));
+
+		std::vector<KeyPosition>().swap(m_Positions);
+		std::vector<KeyRotation>().swap(m_Rotations);
+		std::vector<KeyScale>().swap(m_Scales);
+
+		stats.keysAfter = m_PackedPositions.size() + m_PackedRotations.size() + m_PackedScales.size();
+		stats.bytesAfter = (m_PackedPositions.size() + m_PackedScales.size()) * sizeof(PackedKeyVec3) +
+			m_PackedRotations.size() * sizeof(PackedKeyQuat);
+		return stats;
+	}
+
+	bool IsCompressed() const { return m_Compressed; }
+
+	/* every time any of the three tracks has a key at, sorted, without duplicates */
+	std::vector<float> GetKeyTimes() const
+	{
+		std::vector<float> times;
+		if (m_Compressed)
+		{
+			AppendKeyTimes(m_PackedPositions, times);
+			AppendKeyTimes(m_PackedRotations, times);
+			AppendKeyTimes(m_PackedScales, times);
+		}
+		else
+		{
+			AppendKeyTimes(m_Positions, times);
+			AppendKeyTimes(m_Rotations, times);
+			AppendKeyTimes(m_Scales, times);
+		}
+		std::sort(times.begin(), times.end());
+		times.erase(std::unique(times.begin(), times.end()), times.end());
+		return times;
+	}
+
+	/* replaces the keys, e.g. with ones baked from this bone's own samples. Cursors stay valid.
+	Only for uncompressed bones: compress after baking */
+	void SetKeys(std::vector<KeyPosition> positions, std::vector<KeyRotation> rotations, std::vector<KeyScale> scales)
+	{
+		if (m_Compressed || positions.empty() || rotations.empty() || scales.empty())
+			return;
+		m_Positions = std::move(positions);
+		m_Rotations = std::move(rotations);
+		m_Scales = std::move(scales);
+		m_NumPositions = static_cast<int>(m_Positions.size());
+		m_NumRotations = static_cast<int>(m_Rotations.size());
+		m_NumScalings = static_cast<int>(m_Scales.size());
 	}
+
 	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
 	std::string GetBoneName() const { return m_Name; }
 	int GetBoneID() { return m_ID; }
@@ -87,91 +257,179 @@ public:
 
 	int GetPositionIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumPositions - 1; ++index)
-		{
-			if (animationTime < m_Positions[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		if (m_Compressed)
+			return FindKeyIndex(m_PackedPositions, animationTime, m_Cursor.position);
+		return FindKeyIndex(m_Positions, animationTime, m_Cursor.position);
 	}
 
 	int GetRotationIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumRotations - 1; ++index)
-		{
-			if (animationTime < m_Rotations[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		if (m_Compressed)
+			return FindKeyIndex(m_PackedRotations, animationTime, m_Cursor.rotation);
+		return FindKeyIndex(m_Rotations, animationTime, m_Cursor.rotation);
 	}
 
 	int GetScaleIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumScalings - 1; ++index)
-		{
-			if (animationTime < m_Scales[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		if (m_Compressed)
+			return FindKeyIndex(m_PackedScales, animationTime, m_Cursor.scale);
+		return FindKeyIndex(m_Scales, animationTime, m_Cursor.scale);
 	}
 
 
 private:
 
-	float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
+	/* keys a cursor may walk forward before falling back to a binary search */
+	static const int MAX_CURSOR_STEPS = 4;
+
+	/* index of the key that starts the segment containing animationTime, i.e. keys[index].timeStamp <= animationTime <
+	keys[index + 1].timeStamp. Times before the first or after the last key are clamped to the first or last segment.
+	During playback time only moves forward by a frame, so the segment is the cursor's one or just after it;
+	seeks and loops jump further and use a binary search instead. */
+	template<typename Key>
+	static int FindKeyIndex(const std::vector<Key>& keys, float animationTime, int& cursor)
+	{
+		const int lastSegment = static_cast<int>(keys.size()) - 2;
+		if (animationTime < keys[1].timeStamp)
+			return cursor = 0;
+		if (animationTime >= keys[lastSegment + 1].timeStamp)
+			return cursor = lastSegment;
+
+		if (cursor <= lastSegment && keys[cursor].timeStamp <= animationTime)
+		{
+			for (int step = 0; step < MAX_CURSOR_STEPS; ++step, ++cursor)
+			{
+				if (animationTime < keys[cursor + 1].timeStamp)
+					return cursor;
+			}
+		}
+
+		auto next = std::upper_bound(keys.begin() + 1, keys.begin() + lastSegment + 1, animationTime,
+			[](float time, const Key& key) { return time < key.timeStamp; });
+		return cursor = static_cast<int>(next - keys.begin()) - 1;
+	}
+
+	float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime) const
 	{
 		float scaleFactor = 0.0f;
 		float midWayLength = animationTime - lastTimeStamp;
 		float framesDiff = nextTimeStamp - lastTimeStamp;
 		scaleFactor = midWayLength / framesDiff;
-		return scaleFactor;
+		/* clamped times past either end of the track hold the end key instead of extrapolating */
+		return glm::clamp(scaleFactor, 0.0f, 1.0f);
 	}
 
-	glm::mat4 InterpolatePosition(float animationTime)
+	template<typename Key>
+	static void AppendKeyTimes(const std::vector<Key>& keys, std::vector<float>& times)
 	{
+		for (const Key& key : keys)
+			times.push_back(key.timeStamp);
+	}
+
+	/* reduces and quantizes a vec3 track, setting range to the bounds of the keys kept */
+	template<typename Error>
+	static std::vector<PackedKeyVec3> PackTrack(const std::vector<float>& times, const std::vector<glm::vec3>& values,
+		float tolerance, QuantizationRange& range, Error error)
+	{
+		std::vector<int> kept = ReduceKeys(times, values, tolerance,
+			[](const glm::vec3& a, const glm::vec3& b, float factor) { return glm::mix(a, b, factor); }, error);
+
+		std::vector<glm::vec3> keptValues;
+		for (int index : kept)
+			keptValues.push_back(values[index]);
+		range = QuantizationRange::Of(keptValues);
+
+		std::vector<PackedKeyVec3> packed(kept.size());
+		for (size_t i = 0; i < kept.size(); i++)
+		{
+			range.Encode(keptValues[i], packed[i].value);
+			packed[i].timeStamp = times[kept[i]];
+		}
+		return packed;
+	}
+
+	static float MaxAxisDifference(const glm::vec3& a, const glm::vec3& b)
+	{
+		const glm::vec3 difference = glm::abs(a - b);
+		return std::max(difference.x, std::max(difference.y, difference.z));
+	}
+
+	glm::vec3 InterpolatePacked(const std::vector<PackedKeyVec3>& keys, const QuantizationRange& range,
+		float animationTime, int& cursor) const
+	{
+		if (1 == keys.size())
+			return range.Decode(keys[0].value);
+
+		int p0Index = FindKeyIndex(keys, animationTime, cursor);
+		int p1Index = p0Index + 1;
+		float scaleFactor = GetScaleFactor(keys[p0Index].timeStamp, keys[p1Index].timeStamp, animationTime);
+		return glm::mix(range.Decode(keys[p0Index].value), range.Decode(keys[p1Index].value), scaleFactor);
+	}
+
+	glm::vec3 InterpolatePosition(float animationTime, int& cursor) const
+	{
+		if (m_Compressed)
+			return InterpolatePacked(m_PackedPositions, m_PositionRange, animationTime, cursor);
+
 		if (1 == m_NumPositions)
-			return glm::translate(glm::mat4(1.0f), m_Positions[0].position);
+			return m_Positions[0].position;
 
-		int p0Index = GetPositionIndex(animationTime);
+		int p0Index = FindKeyIndex(m_Positions, animationTime, cursor);
 		int p1Index = p0Index + 1;
 		float scaleFactor = GetScaleFactor(m_Positions[p0Index].timeStamp,
 			m_Positions[p1Index].timeStamp, animationTime);
 		glm::vec3 finalPosition = glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
 			, scaleFactor);
-		return glm::translate(glm::mat4(1.0f), finalPosition);
+		return finalPosition;
 	}
 
-	glm::mat4 InterpolateRotation(float animationTime)
+	glm::quat InterpolateRotation(float animationTime, int& cursor) const
 	{
+		if (m_Compressed)
+		{
+			if (1 == m_NumRotations)
+				return glm::normalize(DecodeQuat(m_PackedRotations[0].value));
+
+			int p0Index = FindKeyIndex(m_PackedRotations, animationTime, cursor);
+			int p1Index = p0Index + 1;
+			float scaleFactor = GetScaleFactor(m_PackedRotations[p0Index].timeStamp,
+				m_PackedRotations[p1Index].timeStamp, animationTime);
+			return glm::normalize(glm::slerp(DecodeQuat(m_PackedRotations[p0Index].value),
+				DecodeQuat(m_PackedRotations[p1Index].value), scaleFactor));
+		}
+
 		if (1 == m_NumRotations)
 		{
 			auto rotation = glm::normalize(m_Rotations[0].orientation);
-			return glm::toMat4(rotation);
+			return rotation;
 		}
 
-		int p0Index = GetRotationIndex(animationTime);
+		int p0Index = FindKeyIndex(m_Rotations, animationTime, cursor);
 		int p1Index = p0Index + 1;
 		float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp,
 			m_Rotations[p1Index].timeStamp, animationTime);
 		glm::quat finalRotation = glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p1Index].orientation
 			, scaleFactor);
 		finalRotation = glm::normalize(finalRotation);
-		return glm::toMat4(finalRotation);
+		return finalRotation;
 
 	}
 
-	glm::mat4 InterpolateScaling(float animationTime)
+	glm::vec3 InterpolateScaling(float animationTime, int& cursor) const
 	{
+		if (m_Compressed)
+			return InterpolatePacked(m_PackedScales, m_ScaleRange, animationTime, cursor);
+
 		if (1 == m_NumScalings)
-			return glm::scale(glm::mat4(1.0f), m_Scales[0].scale);
+			return m_Scales[0].scale;
 
-		int p0Index = GetScaleIndex(animationTime);
+		int p0Index = FindKeyIndex(m_Scales, animationTime, cursor);
 		int p1Index = p0Index + 1;
 		float scaleFactor = GetScaleFactor(m_Scales[p0Index].timeStamp,
 			m_Scales[p1Index].timeStamp, animationTime);
 		glm::vec3 finalScale = glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
 			, scaleFactor);
-		return glm::scale(glm::mat4(1.0f), finalScale);
+		return finalScale;
 	}
 
 	std::vector<KeyPosition> m_Positions;
@@ -181,8 +439,19 @@ private:
 	int m_NumRotations;
 	int m_NumScalings;
 
+	/* replace the three key arrays above once Compress has run */
+	std::vector<PackedKeyVec3> m_PackedPositions;
+	std::vector<PackedKeyQuat> m_PackedRotations;
+	std::vector<PackedKeyVec3> m_PackedScales;
+	QuantizationRange m_PositionRange;
+	QuantizationRange m_ScaleRange;
+
+	/* segments found by the last Update */
+	BoneCursor m_Cursor;
+
 	glm::mat4 m_LocalTransform;
 	std::string m_Name;
 	int m_ID;
+	bool m_Compressed;
 };
 
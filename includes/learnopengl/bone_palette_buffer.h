@@ -0,0 +1,168 @@
+#ifndef BONE_PALETTE_BUFFER_H
+#define BONE_PALETTE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/affine_transform.h>
+
+#include <cstring>
+#include <vector>
+
+// frames the GPU may still be reading while the CPU writes the next one
+#define BONE_PALETTE_FRAMES 3
+// uniform buffer binding point the palette block is attached to
+#define BONE_PALETTE_BINDING 0
+
+// range of the ring buffer holding one character's palette for the current frame
+struct BonePaletteSlot
+{
+    GLintptr offset = 0;
+    GLsizeiptr size = 0;
+
+    bool valid() const { return size > 0; }
+};
+
+// uploads every character's bone palette into one uniform buffer, a range per character per frame, instead of a
+// glUniformMatrix4fv call per bone. The buffer is split into BONE_PALETTE_FRAMES segments used round robin; a fence
+// per segment tells when the GPU is done with it, so writes go through unsynchronized maps and never stall on draws
+// still in flight. (GL 3.3 has no persistent mapping, so each upload maps and unmaps its own range.)
+// the vertex shader reads the palette from
+//     layout (std140) uniform BonePalette { mat4 finalBonesMatrices[MAX_BONES]; };
+// or, uploading Animator::GetAffineBoneMatrices(), from a block of mat3x4 (see AffineTransform)
+class BonePaletteBuffer
+{
+public:
+    // bytes handed out this frame and number of palettes they hold
+    size_t bytesUploaded = 0;
+    unsigned int uploads = 0;
+
+    // room for maxPalettesPerFrame palettes of up to maxBones matrices each, per frame in flight. maxBones has to
+    // match the shader's MAX_BONES
+    BonePaletteBuffer(unsigned int maxPalettesPerFrame, unsigned int maxBones = 100)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        offsetAlignment = static_cast<size_t>(alignment > 0 ? alignment : 1);
+        slotCapacity = alignUp(maxBones * sizeof(glm::mat4));
+        segmentSize = slotCapacity * maxPalettesPerFrame;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, segmentSize * BONE_PALETTE_FRAMES, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        for (unsigned int i = 0; i < BONE_PALETTE_FRAMES; i++)
+            fences[i] = 0;
+    }
+
+    ~BonePaletteBuffer()
+    {
+        for (unsigned int i = 0; i < BONE_PALETTE_FRAMES; i++)
+            if (fences[i])
+                glDeleteSync(fences[i]);
+        glDeleteBuffers(1, &buffer);
+    }
+
+    BonePaletteBuffer(const BonePaletteBuffer&) = delete;
+    BonePaletteBuffer& operator=(const BonePaletteBuffer&) = delete;
+
+    // total size of the GPU buffer, allocated once up front
+    size_t bytesAllocated() const { return segmentSize * BONE_PALETTE_FRAMES; }
+
+    // points the shader's palette block at BONE_PALETTE_BINDING; once per shader, after linking
+    static void bindBlock(const Shader& shader, const char* blockName = "BonePalette")
+    {
+        const GLuint index = glGetUniformBlockIndex(shader.ID, blockName);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, index, BONE_PALETTE_BINDING);
+    }
+
+    // moves on to the next segment, waiting for the GPU to finish the frame that last used it
+    void beginFrame()
+    {
+        segment = (segment + 1) % BONE_PALETTE_FRAMES;
+        if (fences[segment])
+        {
+            GLbitfield flags = 0;
+            while (glClientWaitSync(fences[segment], flags, 1000000) == GL_TIMEOUT_EXPIRED)
+                flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            glDeleteSync(fences[segment]);
+            fences[segment] = 0;
+        }
+        used = 0;
+        bytesUploaded = 0;
+        uploads = 0;
+    }
+
+    // fences the segment once every draw reading it has been issued
+    void endFrame()
+    {
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // copies count matrices into a slot of this frame's segment. Returns an invalid slot when the segment is full
+    // or count is over maxBones
+    BonePaletteSlot upload(const glm::mat4* matrices, unsigned int count)
+    {
+        return uploadBytes(matrices, count * sizeof(glm::mat4));
+    }
+
+    BonePaletteSlot upload(const std::vector<glm::mat4>& palette)
+    {
+        return upload(palette.empty() ? NULL : &palette[0], static_cast<unsigned int>(palette.size()));
+    }
+
+    // 4x3 palette, three quarters of the bytes of the same palette in mat4
+    BonePaletteSlot upload(const std::vector<AffineTransform>& palette)
+    {
+        return uploadBytes(palette.empty() ? NULL : &palette[0], palette.size() * sizeof(AffineTransform));
+    }
+
+    // makes slot the palette the next draws read. The whole slot is bound, maxBones matrices, since GL requires the
+    // bound range to cover the shader's block even when the palette uploaded into it is shorter
+    void bind(const BonePaletteSlot& slot) const
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, BONE_PALETTE_BINDING, buffer, slot.offset, slot.size);
+    }
+
+private:
+    unsigned int buffer;
+    GLsync fences[BONE_PALETTE_FRAMES];
+    size_t offsetAlignment;
+    // bytes of every slot, whatever the size of the palette in it
+    size_t slotCapacity;
+    size_t segmentSize;
+    unsigned int segment = 0;
+    size_t used = 0;
+
+    size_t alignUp(size_t bytes) const
+    {
+        return (bytes + offsetAlignment - 1) / offsetAlignment * offsetAlignment;
+    }
+
+    BonePaletteSlot uploadBytes(const void* data, size_t bytes)
+    {
+        BonePaletteSlot slot;
+        if (bytes == 0 || bytes > slotCapacity || used + slotCapacity > segmentSize)
+            return slot;
+
+        slot.offset = static_cast<GLintptr>(segment * segmentSize + used);
+        slot.size = static_cast<GLsizeiptr>(slotCapacity);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        // only the palette's own bytes are written, the rest of the slot is never read by a well-formed skeleton
+        void* destination = glMapBufferRange(GL_UNIFORM_BUFFER, slot.offset, static_cast<GLsizeiptr>(bytes),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!destination)
+            return BonePaletteSlot();
+        memcpy(destination, data, bytes);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+
+        used += slotCapacity;
+        bytesUploaded += bytes;
+        uploads++;
+        return slot;
+    }
+};
+#endif
@@ -0,0 +1,451 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp> //glm::vec3
+#include <vector> //std::vector
+#include <unordered_map> //std::unordered_map
+#include <algorithm> //std::min, std::max, std::partition, std::nth_element, std::sort
+#include <functional> //std::greater
+#include <limits> //std::numeric_limits
+
+#include <learnopengl/entity.h>
+
+//Bounding volume hierarchy over the global AABBs of an Entity scene.
+//Built once with the surface area heuristic, then kept valid by refitting the boxes of entities that moved.
+//A moved entity moves its whole subtree, so after updateSelfAndChild() call refit(entity) on each entity whose own
+//transform changed (the topmost one of a moved branch is enough), or refit() when most of the scene moved.
+//Frustum queries skip whole subtrees that are fully outside and accept whole subtrees that are fully inside.
+class EntityBVH
+{
+public:
+	//Leaves hold at most this many entities
+	static const int MAX_LEAF_SIZE = 4;
+	//Number of buckets the SAH build sorts centroids into along the split axis
+	static const int SAH_BINS = 12;
+
+	//Collect root and all its descendants and build the tree. Call after the scene's transforms are updated
+	void build(Entity& root)
+	{
+		m_entities.clear();
+		m_boxes.clear();
+		m_nodes.clear();
+		m_leafOf.clear();
+		m_indexOf.clear();
+		collect(root);
+
+		std::vector<int> order(m_entities.size());
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = static_cast<int>(i);
+
+		if (!order.empty())
+		{
+			m_nodes.reserve(2 * order.size());
+			buildNode(order, 0, static_cast<int>(order.size()), -1);
+		}
+
+		//Items are stored in leaf order so a leaf's entities are contiguous
+		std::vector<Entity*> entities(order.size());
+		std::vector<Box> boxes(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			entities[i] = m_entities[order[i]];
+			boxes[i] = m_boxes[order[i]];
+		}
+		m_entities.swap(entities);
+		m_boxes.swap(boxes);
+
+		m_leafOf.assign(m_entities.size(), -1);
+		for (size_t n = 0; n < m_nodes.size(); n++)
+		{
+			for (int i = 0; i < m_nodes[n].count; i++)
+				m_leafOf[m_nodes[n].first + i] = static_cast<int>(n);
+		}
+		for (size_t i = 0; i < m_entities.size(); i++)
+			m_indexOf[m_entities[i]] = static_cast<int>(i);
+	}
+
+	//Recompute the boxes of entity and all its descendants, which moved with it, then the nodes above their leaves,
+	//each once. O(subtree size * depth) at worst
+	void refit(Entity& entity)
+	{
+		m_refitNodes.clear();
+		m_refitMarks.resize(m_nodes.size(), 0);
+		refitSubtree(entity);
+		//Children are always created after their parent, so higher indices first updates every node after its children
+		std::sort(m_refitNodes.begin(), m_refitNodes.end(), std::greater<int>());
+		for (size_t i = 0; i < m_refitNodes.size(); i++)
+		{
+			updateNodeBox(m_refitNodes[i]);
+			m_refitMarks[m_refitNodes[i]] = 0;
+		}
+	}
+
+	//Recompute every box, children before parents. Cheaper than refitting each entity when most of the scene moved
+	void refit()
+	{
+		for (size_t i = 0; i < m_entities.size(); i++)
+			m_boxes[i] = globalBox(*m_entities[i]);
+		//Children are always created after their parent, so walking backwards visits them first
+		for (int node = static_cast<int>(m_nodes.size()) - 1; node >= 0; node--)
+			updateNodeBox(node);
+	}
+
+	//Append every entity whose box is at least partly inside the frustum
+	void queryFrustum(const Frustum& frustum, std::vector<Entity*>& visible) const
+	{
+		if (m_nodes.empty())
+			return;
+		const Plane* planes[6] = { &frustum.leftFace, &frustum.rightFace, &frustum.topFace,
+			&frustum.bottomFace, &frustum.nearFace, &frustum.farFace };
+
+		std::vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+		while (!stack.empty())
+		{
+			const Node& node = m_nodes[stack.back()];
+			stack.pop_back();
+			const Classification result = classify(node.box, planes);
+			if (result == OUTSIDE)
+				continue;
+			if (result == INSIDE)
+			{
+				//Everything below is visible, no more plane tests needed
+				appendSubtree(node, visible);
+				continue;
+			}
+			if (node.count > 0)
+			{
+				for (int i = 0; i < node.count; i++)
+				{
+					if (classify(m_boxes[node.first + i], planes) != OUTSIDE)
+						visible.push_back(m_entities[node.first + i]);
+				}
+			}
+			else
+			{
+				stack.push_back(node.right);
+				stack.push_back(node.left);
+			}
+		}
+	}
+
+	//Closest entity whose box the ray hits within maxDistance, or nullptr. direction doesn't need to be normalized,
+	//distance is then measured in multiples of it. Used for picking
+	Entity* raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* hitDistance = nullptr) const
+	{
+		if (m_nodes.empty())
+			return nullptr;
+		const glm::vec3 invDirection = 1.0f / direction;
+
+		Entity* closest = nullptr;
+		float closestDistance = maxDistance;
+		std::vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+		while (!stack.empty())
+		{
+			const Node& node = m_nodes[stack.back()];
+			stack.pop_back();
+			float entry;
+			if (!intersectRay(node.box, origin, invDirection, closestDistance, entry))
+				continue;
+			if (node.count > 0)
+			{
+				for (int i = 0; i < node.count; i++)
+				{
+					if (intersectRay(m_boxes[node.first + i], origin, invDirection, closestDistance, entry))
+					{
+						closestDistance = entry;
+						closest = m_entities[node.first + i];
+					}
+				}
+				continue;
+			}
+			//Visit the nearer child first so the far one is more likely to be rejected by closestDistance
+			float leftEntry, rightEntry;
+			const bool hitLeft = intersectRay(m_nodes[node.left].box, origin, invDirection, closestDistance, leftEntry);
+			const bool hitRight = intersectRay(m_nodes[node.right].box, origin, invDirection, closestDistance, rightEntry);
+			if (hitLeft && hitRight)
+			{
+				const bool leftFirst = leftEntry <= rightEntry;
+				stack.push_back(leftFirst ? node.right : node.left);
+				stack.push_back(leftFirst ? node.left : node.right);
+			}
+			else if (hitLeft)
+				stack.push_back(node.left);
+			else if (hitRight)
+				stack.push_back(node.right);
+		}
+		if (closest && hitDistance)
+			*hitDistance = closestDistance;
+		return closest;
+	}
+
+	size_t size() const { return m_entities.size(); }
+	size_t nodeCount() const { return m_nodes.size(); }
+
+private:
+	struct Box
+	{
+		glm::vec3 min{ std::numeric_limits<float>::max() };
+		glm::vec3 max{ -std::numeric_limits<float>::max() };
+
+		void grow(const Box& other)
+		{
+			min = glm::min(min, other.min);
+			max = glm::max(max, other.max);
+		}
+
+		void grow(const glm::vec3& point)
+		{
+			min = glm::min(min, point);
+			max = glm::max(max, point);
+		}
+
+		float halfArea() const
+		{
+			const glm::vec3 size = max - min;
+			return size.x * size.y + size.y * size.z + size.z * size.x;
+		}
+	};
+
+	struct Node
+	{
+		Box box;
+		int parent = -1;
+		//Inner nodes: children. Leaves: range of items, count > 0
+		int left = -1, right = -1;
+		int first = 0, count = 0;
+	};
+
+	enum Classification { OUTSIDE, INTERSECTING, INSIDE };
+
+	std::vector<Node> m_nodes;
+	std::vector<Entity*> m_entities;
+	std::vector<Box> m_boxes;
+	std::vector<int> m_leafOf;
+	std::unordered_map<const Entity*, int> m_indexOf;
+	//Scratch for refit(Entity&): nodes to update, and which of them are already listed
+	std::vector<int> m_refitNodes;
+	std::vector<char> m_refitMarks;
+
+	void collect(Entity& entity)
+	{
+		m_entities.push_back(&entity);
+		m_boxes.push_back(globalBox(entity));
+		for (auto&& child : entity.children)
+			collect(*child);
+	}
+
+	void refitSubtree(Entity& entity)
+	{
+		auto it = m_indexOf.find(&entity);
+		if (it != m_indexOf.end())
+		{
+			m_boxes[it->second] = globalBox(entity);
+			//Stop at the first node another entity of the subtree already listed, its ancestors are listed too
+			for (int node = m_leafOf[it->second]; node != -1 && !m_refitMarks[node]; node = m_nodes[node].parent)
+			{
+				m_refitMarks[node] = 1;
+				m_refitNodes.push_back(node);
+			}
+		}
+		for (auto&& child : entity.children)
+			refitSubtree(*child);
+	}
+
+	static Box globalBox(Entity& entity)
+	{
+		const AABB aabb = entity.getGlobalAABB();
+		Box box;
+		box.min = aabb.center - aabb.extents;
+		box.max = aabb.center + aabb.extents;
+		return box;
+	}
+
+	//Builds the node covering order[begin, end) and returns its index. Reorders that range of order
+	int buildNode(std::vector<int>& order, int begin, int end, int parent)
+	{
+		const int index = static_cast<int>(m_nodes.size());
+		m_nodes.push_back(Node());
+		m_nodes[index].parent = parent;
+
+		Box bounds, centroidBounds;
+		for (int i = begin; i < end; i++)
+		{
+			const Box& box = m_boxes[order[i]];
+			bounds.grow(box);
+			centroidBounds.grow((box.min + box.max) * 0.5f);
+		}
+		m_nodes[index].box = bounds;
+
+		const int count = end - begin;
+		int mid = -1;
+		if (count > MAX_LEAF_SIZE)
+			mid = splitSAH(order, begin, end, bounds, centroidBounds);
+
+		if (mid == -1)
+		{
+			m_nodes[index].first = begin;
+			m_nodes[index].count = count;
+			return index;
+		}
+
+		const int left = buildNode(order, begin, mid, index);
+		const int right = buildNode(order, mid, end, index);
+		m_nodes[index].left = left;
+		m_nodes[index].right = right;
+		return index;
+	}
+
+	//Binned SAH: try every bin boundary on every axis, partition at the cheapest. Only called for ranges too big for a
+	//leaf, so it always splits
+	int splitSAH(std::vector<int>& order, int begin, int end, const Box& bounds, const Box& centroidBounds)
+	{
+		const int count = end - begin;
+		float bestCost = static_cast<float>(count) * bounds.halfArea();
+		int bestAxis = -1, bestSplit = 0;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float axisMin = centroidBounds.min[axis];
+			const float axisExtent = centroidBounds.max[axis] - axisMin;
+			if (axisExtent <= 0.0f)
+				continue;
+
+			Box binBoxes[SAH_BINS];
+			int binCounts[SAH_BINS] = {};
+			for (int i = begin; i < end; i++)
+			{
+				const Box& box = m_boxes[order[i]];
+				const int bin = binOf((box.min[axis] + box.max[axis]) * 0.5f, axisMin, axisExtent);
+				binBoxes[bin].grow(box);
+				binCounts[bin]++;
+			}
+
+			//Sweep from the right to get the cost of everything past each boundary
+			float rightCost[SAH_BINS];
+			Box rightBox;
+			int rightCount = 0;
+			for (int bin = SAH_BINS - 1; bin > 0; bin--)
+			{
+				rightBox.grow(binBoxes[bin]);
+				rightCount += binCounts[bin];
+				rightCost[bin] = rightCount ? rightCount * rightBox.halfArea() : 0.0f;
+			}
+			Box leftBox;
+			int leftCount = 0;
+			for (int bin = 0; bin < SAH_BINS - 1; bin++)
+			{
+				leftBox.grow(binBoxes[bin]);
+				leftCount += binCounts[bin];
+				if (leftCount == 0 || leftCount == count)
+					continue;
+				const float cost = leftCount * leftBox.halfArea() + rightCost[bin + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = bin + 1;
+				}
+			}
+		}
+
+		if (bestAxis == -1)
+		{
+			//No split beats a leaf, but the range is over MAX_LEAF_SIZE: split at the centroid median of the widest axis
+			//so leaves keep the size queries and refits count on
+			const glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+			const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+			const int mid = begin + count / 2;
+			std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](int a, int b)
+				{
+					return m_boxes[a].min[axis] + m_boxes[a].max[axis] < m_boxes[b].min[axis] + m_boxes[b].max[axis];
+				});
+			return mid;
+		}
+
+		const float axisMin = centroidBounds.min[bestAxis];
+		const float axisExtent = centroidBounds.max[bestAxis] - axisMin;
+		auto middle = std::partition(order.begin() + begin, order.begin() + end, [&](int item)
+			{
+				const Box& box = m_boxes[item];
+				return binOf((box.min[bestAxis] + box.max[bestAxis]) * 0.5f, axisMin, axisExtent) < bestSplit;
+			});
+		return static_cast<int>(middle - order.begin());
+	}
+
+	static int binOf(float centroid, float axisMin, float axisExtent)
+	{
+		const int bin = static_cast<int>((centroid - axisMin) / axisExtent * SAH_BINS);
+		return std::min(std::max(bin, 0), SAH_BINS - 1);
+	}
+
+	void updateNodeBox(int index)
+	{
+		Node& node = m_nodes[index];
+		Box box;
+		if (node.count > 0)
+		{
+			for (int i = 0; i < node.count; i++)
+				box.grow(m_boxes[node.first + i]);
+		}
+		else
+		{
+			box = m_nodes[node.left].box;
+			box.grow(m_nodes[node.right].box);
+		}
+		node.box = box;
+	}
+
+	void appendSubtree(const Node& node, std::vector<Entity*>& visible) const
+	{
+		if (node.count > 0)
+		{
+			visible.insert(visible.end(), m_entities.begin() + node.first, m_entities.begin() + node.first + node.count);
+			return;
+		}
+		appendSubtree(m_nodes[node.left], visible);
+		appendSubtree(m_nodes[node.right], visible);
+	}
+
+	static Classification classify(const Box& box, const Plane* const planes[6])
+	{
+		const glm::vec3 center = (box.min + box.max) * 0.5f;
+		const glm::vec3 extents = box.max - center;
+		Classification result = INSIDE;
+		for (int p = 0; p < 6; p++)
+		{
+			const Plane& plane = *planes[p];
+			// Compute the projection interval radius of b onto L(t) = b.c + t * p.n
+			const float r = extents.x * std::abs(plane.normal.x) + extents.y * std::abs(plane.normal.y) +
+				extents.z * std::abs(plane.normal.z);
+			const float distance = plane.getSignedDistanceToPlane(center);
+			if (distance < -r)
+				return OUTSIDE;
+			if (distance < r)
+				result = INTERSECTING;
+		}
+		return result;
+	}
+
+	//Slab test. entry is where the ray enters the box (0 if it starts inside)
+	static bool intersectRay(const Box& box, const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance, float& entry)
+	{
+		entry = 0.0f;
+		float exit = maxDistance;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float t0 = (box.min[axis] - origin[axis]) * invDirection[axis];
+			const float t1 = (box.max[axis] - origin[axis]) * invDirection[axis];
+			//0 * inf: the ray is parallel to this axis' slab and starts on one of its planes, so it stays inside it
+			if (t0 != t0 || t1 != t1)
+				continue;
+			entry = std::max(entry, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		return entry <= exit;
+	}
+};
+#endif
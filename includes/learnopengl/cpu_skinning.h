@@ -0,0 +1,205 @@
+#ifndef CPU_SKINNING_H
+#define CPU_SKINNING_H
+
+#include <glm/glm.hpp> //glm::mat4
+#include <vector> //std::vector
+#include <cstddef> //offsetof
+#include <cmath> //std::sqrt
+
+#include <learnopengl/mesh.h> //Vertex
+#include <learnopengl/thread_pool.h>
+
+//8 vertices per iteration with AVX2 gathers, otherwise one at a time
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_SKINNING_AVX2
+#endif
+
+//Skinned positions, normals and tangents, one array per component, indexed like the mesh's vertices
+struct SkinnedVertices
+{
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> normalX, normalY, normalZ;
+	std::vector<float> tangentX, tangentY, tangentZ;
+
+	size_t size() const { return positionX.size(); }
+
+	void resize(size_t count)
+	{
+		positionX.resize(count); positionY.resize(count); positionZ.resize(count);
+		normalX.resize(count); normalY.resize(count); normalZ.resize(count);
+		tangentX.resize(count); tangentY.resize(count); tangentZ.resize(count);
+	}
+
+	glm::vec3 position(size_t i) const { return glm::vec3(positionX[i], positionY[i], positionZ[i]); }
+	glm::vec3 normal(size_t i) const { return glm::vec3(normalX[i], normalY[i], normalZ[i]); }
+	glm::vec3 tangent(size_t i) const { return glm::vec3(tangentX[i], tangentY[i], tangentZ[i]); }
+};
+
+//vertices per task when skinning on a ThreadPool, a multiple of the SIMD width so only the last chunk has a tail
+#define SKINNING_CHUNK_SIZE 2048
+
+//Scalar reference, same math as the skinning vertex shader: each influence with a bone id in the palette adds
+//weight * palette[id] to the vertex's matrix, normals and tangents go through its upper 3x3 and are renormalized.
+//Unlike the shader, a vertex without any influence keeps its bind pose instead of collapsing to the origin.
+//Writes [begin, end) of out, which must already hold vertices.size() entries
+inline void skinVerticesScalar(const std::vector<Vertex>& vertices, const std::vector<glm::mat4>& palette,
+	size_t begin, size_t end, SkinnedVertices& out)
+{
+	const int boneCount = static_cast<int>(palette.size());
+	for (size_t i = begin; i < end; i++)
+	{
+		const Vertex& vertex = vertices[i];
+		glm::mat4 skin(0.0f);
+		float totalWeight = 0.0f;
+		for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+		{
+			const int id = vertex.m_BoneIDs[j];
+			if (id < 0 || id >= boneCount)
+				continue;
+			skin += palette[id] * vertex.m_Weights[j];
+			totalWeight += vertex.m_Weights[j];
+		}
+		if (totalWeight == 0.0f)
+			skin = glm::mat4(1.0f);
+
+		const glm::vec3 position = glm::vec3(skin * glm::vec4(vertex.Position, 1.0f));
+		glm::vec3 normal = glm::mat3(skin) * vertex.Normal;
+		glm::vec3 tangent = glm::mat3(skin) * vertex.Tangent;
+		const float normalLength = glm::length(normal);
+		const float tangentLength = glm::length(tangent);
+		if (normalLength > 0.0f)
+			normal /= normalLength;
+		if (tangentLength > 0.0f)
+			tangent /= tangentLength;
+
+		out.positionX[i] = position.x; out.positionY[i] = position.y; out.positionZ[i] = position.z;
+		out.normalX[i] = normal.x; out.normalY[i] = normal.y; out.normalZ[i] = normal.z;
+		out.tangentX[i] = tangent.x; out.tangentY[i] = tangent.y; out.tangentZ[i] = tangent.z;
+	}
+}
+
+#if defined(CPU_SKINNING_AVX2)
+//v / |v| per lane, leaving zero-length vectors alone like the scalar path
+inline void normalizeLanes(__m256& x, __m256& y, __m256& z)
+{
+	const __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+	const __m256 nonZero = _mm256_cmp_ps(length, _mm256_setzero_ps(), _CMP_GT_OQ);
+	const __m256 divisor = _mm256_blendv_ps(_mm256_set1_ps(1.0f), length, nonZero);
+	x = _mm256_div_ps(x, divisor);
+	y = _mm256_div_ps(y, divisor);
+	z = _mm256_div_ps(z, divisor);
+}
+#endif
+
+//Skin [begin, end) of vertices into out, 8 vertices at a time where AVX2 is available. Palette matrices are blended
+//a vertex at a time with contiguous loads (cheaper than gathering 12 components per influence), the vertex fields
+//are gathered straight out of the Vertex array and everything after the blend runs one vertex per lane
+inline void skinVertexRange(const std::vector<Vertex>& vertices, const std::vector<glm::mat4>& palette,
+	size_t begin, size_t end, SkinnedVertices& out)
+{
+	size_t i = begin;
+
+#if defined(CPU_SKINNING_AVX2)
+	const int stride = static_cast<int>(sizeof(Vertex) / sizeof(float));
+	const __m256i lane = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+	const int boneCount = static_cast<int>(palette.size());
+
+	for (; i + 8 <= end; i += 8)
+	{
+		const float* base = reinterpret_cast<const float*>(&vertices[i]);
+
+		// blend each vertex's matrix with whole-matrix adds (two registers per mat4), then transpose rows 0-2 of
+		// every column into one register per component (the fourth row of an affine palette is never needed)
+		alignas(32) float blended[12][8];
+		for (int v = 0; v < 8; v++)
+		{
+			const Vertex& vertex = vertices[i + v];
+			__m256 low = _mm256_setzero_ps(), high = _mm256_setzero_ps();
+			float totalWeight = 0.0f;
+			for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+			{
+				const int id = vertex.m_BoneIDs[j];
+				if (id < 0 || id >= boneCount)
+					continue;
+				const float* entry = &palette[id][0][0];
+				const __m256 weight = _mm256_set1_ps(vertex.m_Weights[j]);
+				low = _mm256_add_ps(low, _mm256_mul_ps(_mm256_loadu_ps(entry), weight));
+				high = _mm256_add_ps(high, _mm256_mul_ps(_mm256_loadu_ps(entry + 8), weight));
+				totalWeight += vertex.m_Weights[j];
+			}
+			// vertices without influences keep their bind pose
+			if (totalWeight == 0.0f)
+			{
+				low = _mm256_setr_ps(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
+				high = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+			}
+			alignas(32) float matrix[16];
+			_mm256_store_ps(matrix, low);
+			_mm256_store_ps(matrix + 8, high);
+			for (int c = 0; c < 4; c++)
+				for (int r = 0; r < 3; r++)
+					blended[c * 3 + r][v] = matrix[c * 4 + r];
+		}
+		__m256 m[4][3];
+		for (int c = 0; c < 4; c++)
+			for (int r = 0; r < 3; r++)
+				m[c][r] = _mm256_load_ps(blended[c * 3 + r]);
+
+		const auto gatherField = [&](size_t offset) {
+			return _mm256_i32gather_ps(base, _mm256_add_epi32(lane, _mm256_set1_epi32(static_cast<int>(offset / sizeof(float)))), 4);
+		};
+		const auto transform = [&](const __m256& x, const __m256& y, const __m256& z, int r) {
+			return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0][r], x), _mm256_mul_ps(m[1][r], y)), _mm256_mul_ps(m[2][r], z));
+		};
+
+		const __m256 px = gatherField(offsetof(Vertex, Position));
+		const __m256 py = gatherField(offsetof(Vertex, Position) + sizeof(float));
+		const __m256 pz = gatherField(offsetof(Vertex, Position) + 2 * sizeof(float));
+		_mm256_storeu_ps(&out.positionX[i], _mm256_add_ps(transform(px, py, pz, 0), m[3][0]));
+		_mm256_storeu_ps(&out.positionY[i], _mm256_add_ps(transform(px, py, pz, 1), m[3][1]));
+		_mm256_storeu_ps(&out.positionZ[i], _mm256_add_ps(transform(px, py, pz, 2), m[3][2]));
+
+		const __m256 nx = gatherField(offsetof(Vertex, Normal));
+		const __m256 ny = gatherField(offsetof(Vertex, Normal) + sizeof(float));
+		const __m256 nz = gatherField(offsetof(Vertex, Normal) + 2 * sizeof(float));
+		__m256 sx = transform(nx, ny, nz, 0), sy = transform(nx, ny, nz, 1), sz = transform(nx, ny, nz, 2);
+		normalizeLanes(sx, sy, sz);
+		_mm256_storeu_ps(&out.normalX[i], sx);
+		_mm256_storeu_ps(&out.normalY[i], sy);
+		_mm256_storeu_ps(&out.normalZ[i], sz);
+
+		const __m256 tx = gatherField(offsetof(Vertex, Tangent));
+		const __m256 ty = gatherField(offsetof(Vertex, Tangent) + sizeof(float));
+		const __m256 tz = gatherField(offsetof(Vertex, Tangent) + 2 * sizeof(float));
+		sx = transform(tx, ty, tz, 0); sy = transform(tx, ty, tz, 1); sz = transform(tx, ty, tz, 2);
+		normalizeLanes(sx, sy, sz);
+		_mm256_storeu_ps(&out.tangentX[i], sx);
+		_mm256_storeu_ps(&out.tangentY[i], sy);
+		_mm256_storeu_ps(&out.tangentZ[i], sz);
+	}
+#endif
+
+	// whatever doesn't fill a whole register
+	skinVerticesScalar(vertices, palette, i, end, out);
+}
+
+//Skin every vertex with the bone palette (e.g. Animator::GetFinalBoneMatrices()) into out, resized to match.
+//Needs no GL context, so it also works as a headless check of what an animation does to a mesh
+inline void skinVertices(const std::vector<Vertex>& vertices, const std::vector<glm::mat4>& palette, SkinnedVertices& out)
+{
+	out.resize(vertices.size());
+	skinVertexRange(vertices, palette, 0, vertices.size(), out);
+}
+
+//Same, split into SKINNING_CHUNK_SIZE vertex ranges across the pool
+inline void skinVertices(const std::vector<Vertex>& vertices, const std::vector<glm::mat4>& palette, SkinnedVertices& out,
+	ThreadPool& pool)
+{
+	out.resize(vertices.size());
+	pool.parallelFor(0, vertices.size(), SKINNING_CHUNK_SIZE, [&](size_t begin, size_t end)
+		{
+			skinVertexRange(vertices, palette, begin, end, out);
+		});
+}
+#endif
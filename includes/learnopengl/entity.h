@@ -6,6 +6,10 @@
 #include <array> //std::array
 #include <memory> //std::unique_ptr
 
+#include <learnopengl/render_queue.h>
+#include <learnopengl/instance_batcher.h>
+#include <learnopengl/thread_pool.h>
+
 class Transform
 {
 protected:
@@ -65,7 +69,7 @@ public:
 		m_isDirty = true;
 	}
 
-	const glm::vec3& getGlobalPosition() const
+	glm::vec3 getGlobalPosition() const
 	{
 		return m_modelMatrix[3];
 	}
@@ -465,6 +469,23 @@ public:
 		}
 	}
 
+	//Same as updateSelfAndChild, but independent subtrees are updated in parallel on the pool.
+	//Every matrix is computed exactly like the serial path, only the order of independent subtrees changes
+	void updateSelfAndChild(ThreadPool& pool)
+	{
+		TaskGroup group;
+		updateSelfAndChild(pool, group);
+		pool.wait(group);
+	}
+
+	//Parallel version of forceUpdateSelfAndChild
+	void forceUpdateSelfAndChild(ThreadPool& pool)
+	{
+		TaskGroup group;
+		forceUpdateSelfAndChild(pool, group);
+		pool.wait(group);
+	}
+
 
 	void drawSelfAndChild(const Frustum& frustum, Shader& ourShader, unsigned int& display, unsigned int& total)
 	{
@@ -481,5 +502,94 @@ public:
 			child->drawSelfAndChild(frustum, ourShader, display, total);
 		}
 	}
+
+	//Same culling as drawSelfAndChild, but visible entities are only queued. Sort and submit the queue once the whole scene is collected
+	void collectSelfAndChild(const Frustum& frustum, Shader& ourShader, RenderQueue& queue, unsigned int& display, unsigned int& total)
+	{
+		if (boundingVolume->isOnFrustum(frustum, transform))
+		{
+			//Distance in front of the near plane, used to draw front to back inside a batch
+			const float depth = frustum.nearFace.getSignedDistanceToPlane(transform.getGlobalPosition());
+			queue.push(ourShader, *pModel, transform.getModelMatrix(), depth);
+			display++;
+		}
+		total++;
+
+		for (auto&& child : children)
+		{
+			child->collectSelfAndChild(frustum, ourShader, queue, display, total);
+		}
+	}
+
+	//Same culling again, but visible entities are grouped by model so they can be drawn with one instanced call per mesh
+	void collectSelfAndChild(const Frustum& frustum, InstanceBatcher& batcher, unsigned int& display, unsigned int& total)
+	{
+		if (boundingVolume->isOnFrustum(frustum, transform))
+		{
+			batcher.push(*pModel, transform.getModelMatrix());
+			display++;
+		}
+		total++;
+
+		for (auto&& child : children)
+		{
+			child->collectSelfAndChild(frustum, batcher, display, total);
+		}
+	}
+
+private:
+	//Children handed to one task. Small enough to balance wide levels, big enough that a task outweighs its scheduling
+	static const unsigned int UPDATE_CHUNK_SIZE = 32;
+
+	void updateSelfAndChild(ThreadPool& pool, TaskGroup& group)
+	{
+		if (transform.isDirty()) {
+			forceUpdateSelfAndChild(pool, group);
+			return;
+		}
+
+		forEachChildChunk(pool, group, [&pool, &group](Entity& child) { child.updateSelfAndChild(pool, group); });
+	}
+
+	void forceUpdateSelfAndChild(ThreadPool& pool, TaskGroup& group)
+	{
+		if (parent)
+			transform.computeModelMatrix(parent->transform.getModelMatrix());
+		else
+			transform.computeModelMatrix();
+
+		forEachChildChunk(pool, group, [&pool, &group](Entity& child) { child.forceUpdateSelfAndChild(pool, group); });
+	}
+
+	//Runs function on every child. Children are split in chunks queued on the pool, the last chunk runs on the calling thread
+	template<typename Function>
+	void forEachChildChunk(ThreadPool& pool, TaskGroup& group, const Function& function)
+	{
+		auto chunkBegin = children.begin();
+		while (chunkBegin != children.end())
+		{
+			auto chunkEnd = chunkBegin;
+			unsigned int count = 0;
+			while (chunkEnd != children.end() && count < UPDATE_CHUNK_SIZE)
+			{
+				++chunkEnd;
+				++count;
+			}
+
+			if (chunkEnd == children.end())
+			{
+				for (auto it = chunkBegin; it != chunkEnd; ++it)
+					function(**it);
+			}
+			else
+			{
+				pool.submit(group, [chunkBegin, chunkEnd, function]() {
+					for (auto it = chunkBegin; it != chunkEnd; ++it)
+						function(**it);
+				});
+			}
+			chunkBegin = chunkEnd;
+		}
+	}
 };
 #endif
@@ -0,0 +1,184 @@
+#ifndef FLAT_SCENE_H
+#define FLAT_SCENE_H
+
+#include <glm/glm.hpp> //glm::mat4
+#include <glm/gtc/matrix_transform.hpp> //glm::translate, glm::rotate, glm::scale
+#include <vector> //std::vector
+#include <cstdint> //uint8_t
+#include <algorithm> //std::fill
+
+class FlatScene;
+
+//Lightweight handle on a node of a FlatScene. Same transform API as Entity, but the data lives in the scene's arrays
+class SceneNode
+{
+public:
+	SceneNode() = default;
+	SceneNode(FlatScene* scene, unsigned int index) : m_scene{ scene }, m_index{ index } {}
+
+	SceneNode addChild();
+
+	void setLocalPosition(const glm::vec3& newPosition);
+	void setLocalRotation(const glm::vec3& newRotation);
+	void setLocalScale(const glm::vec3& newScale);
+
+	const glm::vec3& getLocalPosition() const;
+	const glm::vec3& getLocalRotation() const;
+	const glm::vec3& getLocalScale() const;
+	const glm::mat4& getModelMatrix() const;
+	SceneNode getParent() const;
+
+	bool isValid() const { return m_scene != nullptr; }
+	unsigned int index() const { return m_index; }
+
+private:
+	FlatScene* m_scene = nullptr;
+	unsigned int m_index = 0;
+};
+
+//Data-oriented scene graph: every node's transform lives in contiguous arrays (SoA) instead of one heap Entity per node.
+//Nodes are only ever appended and a child is always created after its parent, so parents precede children and
+//the world matrices are updated in a single linear pass, without recursion or pointer chasing.
+class FlatScene
+{
+public:
+	static const int NO_PARENT = -1;
+
+	//Create a root node
+	SceneNode addRoot()
+	{
+		return SceneNode(this, addNode(NO_PARENT));
+	}
+
+	//Create a child of an existing node. Appending keeps the parent-before-child order
+	SceneNode addChild(unsigned int parent)
+	{
+		return SceneNode(this, addNode(static_cast<int>(parent)));
+	}
+
+	void reserve(size_t count)
+	{
+		m_pos.reserve(count);
+		m_eulerRot.reserve(count);
+		m_scale.reserve(count);
+		m_parent.reserve(count);
+		m_dirty.reserve(count);
+		m_modelMatrix.reserve(count);
+	}
+
+	//Update world matrices of every dirty node and of everything below it
+	void update()
+	{
+		const size_t count = m_parent.size();
+		for (size_t i = 0; i < count; i++)
+		{
+			const int parent = m_parent[i];
+			//A node whose parent moved this pass is dirty too. m_dirty[parent] is already final since parent < i
+			if (parent != NO_PARENT && m_dirty[parent])
+				m_dirty[i] = 1;
+
+			if (m_dirty[i])
+			{
+				const glm::mat4 local = getLocalModelMatrix(i);
+				m_modelMatrix[i] = parent == NO_PARENT ? local : m_modelMatrix[parent] * local;
+			}
+		}
+		//Cleared in a second pass: children read their parent's flag during the first one
+		std::fill(m_dirty.begin(), m_dirty.end(), 0);
+	}
+
+	//Update every node even if local space didn't change
+	void forceUpdate()
+	{
+		std::fill(m_dirty.begin(), m_dirty.end(), 1);
+		update();
+	}
+
+	size_t size() const { return m_parent.size(); }
+	int getParent(unsigned int node) const { return m_parent[node]; }
+	bool isDirty(unsigned int node) const { return m_dirty[node] != 0; }
+
+	//Space information, indexed by node
+	const glm::vec3& getLocalPosition(unsigned int node) const { return m_pos[node]; }
+	const glm::vec3& getLocalRotation(unsigned int node) const { return m_eulerRot[node]; }
+	const glm::vec3& getLocalScale(unsigned int node) const { return m_scale[node]; }
+	const glm::mat4& getModelMatrix(unsigned int node) const { return m_modelMatrix[node]; }
+	const std::vector<glm::mat4>& getModelMatrices() const { return m_modelMatrix; }
+
+	void setLocalPosition(unsigned int node, const glm::vec3& newPosition)
+	{
+		m_pos[node] = newPosition;
+		m_dirty[node] = 1;
+	}
+
+	void setLocalRotation(unsigned int node, const glm::vec3& newRotation)
+	{
+		m_eulerRot[node] = newRotation;
+		m_dirty[node] = 1;
+	}
+
+	void setLocalScale(unsigned int node, const glm::vec3& newScale)
+	{
+		m_scale[node] = newScale;
+		m_dirty[node] = 1;
+	}
+
+private:
+	//Local space information
+	std::vector<glm::vec3> m_pos;
+	std::vector<glm::vec3> m_eulerRot; //In degrees
+	std::vector<glm::vec3> m_scale;
+
+	//Hierarchy, parent index is always lower than the node's own index
+	std::vector<int> m_parent;
+
+	//Dirty flag, a byte per node rather than std::vector<bool> so reads and writes stay plain loads and stores
+	std::vector<uint8_t> m_dirty;
+
+	//Global space information concatenate in matrix
+	std::vector<glm::mat4> m_modelMatrix;
+
+	unsigned int addNode(int parent)
+	{
+		m_pos.push_back({ 0.0f, 0.0f, 0.0f });
+		m_eulerRot.push_back({ 0.0f, 0.0f, 0.0f });
+		m_scale.push_back({ 1.0f, 1.0f, 1.0f });
+		m_parent.push_back(parent);
+		m_dirty.push_back(1);
+		m_modelMatrix.push_back(glm::mat4(1.0f));
+		return static_cast<unsigned int>(m_parent.size() - 1);
+	}
+
+	//Same composition as Transform::getLocalModelMatrix so both scene representations give identical matrices
+	glm::mat4 getLocalModelMatrix(size_t node) const
+	{
+		const glm::vec3& eulerRot = m_eulerRot[node];
+		const glm::mat4 transformX = glm::rotate(glm::mat4(1.0f), glm::radians(eulerRot.x), glm::vec3(1.0f, 0.0f, 0.0f));
+		const glm::mat4 transformY = glm::rotate(glm::mat4(1.0f), glm::radians(eulerRot.y), glm::vec3(0.0f, 1.0f, 0.0f));
+		const glm::mat4 transformZ = glm::rotate(glm::mat4(1.0f), glm::radians(eulerRot.z), glm::vec3(0.0f, 0.0f, 1.0f));
+
+		// Y * X * Z
+		const glm::mat4 rotationMatrix = transformY * transformX * transformZ;
+
+		// translation * rotation * scale (also know as TRS matrix)
+		return glm::translate(glm::mat4(1.0f), m_pos[node]) * rotationMatrix * glm::scale(glm::mat4(1.0f), m_scale[node]);
+	}
+};
+
+inline SceneNode SceneNode::addChild() { return m_scene->addChild(m_index); }
+
+inline void SceneNode::setLocalPosition(const glm::vec3& newPosition) { m_scene->setLocalPosition(m_index, newPosition); }
+inline void SceneNode::setLocalRotation(const glm::vec3& newRotation) { m_scene->setLocalRotation(m_index, newRotation); }
+inline void SceneNode::setLocalScale(const glm::vec3& newScale) { m_scene->setLocalScale(m_index, newScale); }
+
+inline const glm::vec3& SceneNode::getLocalPosition() const { return m_scene->getLocalPosition(m_index); }
+inline const glm::vec3& SceneNode::getLocalRotation() const { return m_scene->getLocalRotation(m_index); }
+inline const glm::vec3& SceneNode::getLocalScale() const { return m_scene->getLocalScale(m_index); }
+inline const glm::mat4& SceneNode::getModelMatrix() const { return m_scene->getModelMatrix(m_index); }
+
+inline SceneNode SceneNode::getParent() const
+{
+	const int parent = m_scene->getParent(m_index);
+	return parent == FlatScene::NO_PARENT ? SceneNode() : SceneNode(m_scene, static_cast<unsigned int>(parent));
+}
+#endif
@@ -0,0 +1,193 @@
+#ifndef FRUSTUM_CULLING_H
+#define FRUSTUM_CULLING_H
+
+#include <glm/glm.hpp> //glm::vec3
+#include <vector> //std::vector
+#include <cstdint> //uint32_t
+#include <cmath> //std::abs
+
+#include <learnopengl/entity.h>
+
+//Pick the widest instruction set the compiler targets. Every path does the same float operations in the same order
+//as AABB::isOnOrForwardPlane, so all of them give bit-identical masks (as long as the compiler doesn't fuse
+//multiply-adds, e.g. -ffp-contract=off on GCC/Clang; MSVC's default /fp:precise already doesn't)
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLING_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_CULLING_SSE
+#endif
+
+//World-space AABBs stored as separate arrays per component, so several boxes load into one SIMD register
+struct AABBArray
+{
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	size_t size() const { return centerX.size(); }
+
+	void clear()
+	{
+		centerX.clear(); centerY.clear(); centerZ.clear();
+		extentX.clear(); extentY.clear(); extentZ.clear();
+	}
+
+	void reserve(size_t count)
+	{
+		centerX.reserve(count); centerY.reserve(count); centerZ.reserve(count);
+		extentX.reserve(count); extentY.reserve(count); extentZ.reserve(count);
+	}
+
+	void push(const glm::vec3& center, const glm::vec3& extents)
+	{
+		centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+		extentX.push_back(extents.x); extentY.push_back(extents.y); extentZ.push_back(extents.z);
+	}
+
+	void push(const AABB& aabb)
+	{
+		push(aabb.center, aabb.extents);
+	}
+
+	//Transform a local AABB by the transform and store the AABB enclosing the result, same as Entity::getGlobalAABB.
+	//Dotting against unit axes only picks a component, so the extents are sums of absolute matrix components
+	void push(const AABB& localAABB, const Transform& transform)
+	{
+		const glm::vec3 globalCenter{ transform.getModelMatrix() * glm::vec4(localAABB.center, 1.f) };
+
+		// Scaled orientation
+		const glm::vec3 right = transform.getRight() * localAABB.extents.x;
+		const glm::vec3 up = transform.getUp() * localAABB.extents.y;
+		const glm::vec3 forward = transform.getForward() * localAABB.extents.z;
+
+		const glm::vec3 globalExtents{
+			std::abs(right.x) + std::abs(up.x) + std::abs(forward.x),
+			std::abs(right.y) + std::abs(up.y) + std::abs(forward.y),
+			std::abs(right.z) + std::abs(up.z) + std::abs(forward.z) };
+		push(globalCenter, globalExtents);
+	}
+};
+
+//Number of 32 bit words needed by a visibility mask of count boxes
+inline size_t visibilityMaskWords(size_t count)
+{
+	return (count + 31) / 32;
+}
+
+inline bool isVisible(const std::vector<uint32_t>& mask, size_t index)
+{
+	return (mask[index / 32] >> (index % 32)) & 1u;
+}
+
+//Scalar reference: same test as AABB::isOnFrustum without the transform, one box at a time
+inline void cullAABBsScalar(const Frustum& frustum, const AABBArray& boxes, size_t begin, size_t end, uint32_t* mask)
+{
+	const Plane* planes[6] = { &frustum.leftFace, &frustum.rightFace, &frustum.topFace,
+		&frustum.bottomFace, &frustum.nearFace, &frustum.farFace };
+
+	for (size_t i = begin; i < end; i++)
+	{
+		bool visible = true;
+		for (int p = 0; p < 6; p++)
+		{
+			const Plane& plane = *planes[p];
+			// Compute the projection interval radius of b onto L(t) = b.c + t * p.n
+			const float r = boxes.extentX[i] * std::abs(plane.normal.x) + boxes.extentY[i] * std::abs(plane.normal.y) +
+				boxes.extentZ[i] * std::abs(plane.normal.z);
+			const float d = plane.normal.x * boxes.centerX[i] + plane.normal.y * boxes.centerY[i] +
+				plane.normal.z * boxes.centerZ[i] - plane.distance;
+			visible = visible && (-r <= d);
+		}
+		if (visible)
+			mask[i / 32] |= 1u << (i % 32);
+	}
+}
+
+//Test every box against the six planes and write bit i of mask for box i (1 = at least partly inside).
+//mask is resized to visibilityMaskWords(boxes.size()) and cleared first
+inline void cullAABBs(const Frustum& frustum, const AABBArray& boxes, std::vector<uint32_t>& mask)
+{
+	const size_t count = boxes.size();
+	mask.assign(visibilityMaskWords(count), 0u);
+	size_t i = 0;
+
+#if defined(FRUSTUM_CULLING_AVX) || defined(FRUSTUM_CULLING_SSE)
+	const Plane* planes[6] = { &frustum.leftFace, &frustum.rightFace, &frustum.topFace,
+		&frustum.bottomFace, &frustum.nearFace, &frustum.farFace };
+#endif
+
+#if defined(FRUSTUM_CULLING_AVX)
+	__m256 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], dist[6];
+	for (int p = 0; p < 6; p++)
+	{
+		nx[p] = _mm256_set1_ps(planes[p]->normal.x);
+		ny[p] = _mm256_set1_ps(planes[p]->normal.y);
+		nz[p] = _mm256_set1_ps(planes[p]->normal.z);
+		ax[p] = _mm256_set1_ps(std::abs(planes[p]->normal.x));
+		ay[p] = _mm256_set1_ps(std::abs(planes[p]->normal.y));
+		az[p] = _mm256_set1_ps(std::abs(planes[p]->normal.z));
+		dist[p] = _mm256_set1_ps(planes[p]->distance);
+	}
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+	// 8 boxes per iteration, 4 iterations fill one mask word
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256 cx = _mm256_loadu_ps(&boxes.centerX[i]);
+		const __m256 cy = _mm256_loadu_ps(&boxes.centerY[i]);
+		const __m256 cz = _mm256_loadu_ps(&boxes.centerZ[i]);
+		const __m256 ex = _mm256_loadu_ps(&boxes.extentX[i]);
+		const __m256 ey = _mm256_loadu_ps(&boxes.extentY[i]);
+		const __m256 ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+
+		__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			const __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ax[p]), _mm256_mul_ps(ey, ay[p])), _mm256_mul_ps(ez, az[p]));
+			const __m256 d = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)),
+				_mm256_mul_ps(nz[p], cz)), dist[p]);
+			visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_xor_ps(r, signBit), d, _CMP_LE_OQ));
+		}
+		mask[i / 32] |= static_cast<uint32_t>(_mm256_movemask_ps(visible)) << (i % 32);
+	}
+#elif defined(FRUSTUM_CULLING_SSE)
+	__m128 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], dist[6];
+	for (int p = 0; p < 6; p++)
+	{
+		nx[p] = _mm_set1_ps(planes[p]->normal.x);
+		ny[p] = _mm_set1_ps(planes[p]->normal.y);
+		nz[p] = _mm_set1_ps(planes[p]->normal.z);
+		ax[p] = _mm_set1_ps(std::abs(planes[p]->normal.x));
+		ay[p] = _mm_set1_ps(std::abs(planes[p]->normal.y));
+		az[p] = _mm_set1_ps(std::abs(planes[p]->normal.z));
+		dist[p] = _mm_set1_ps(planes[p]->distance);
+	}
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	// 4 boxes per iteration, 8 iterations fill one mask word
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 cx = _mm_loadu_ps(&boxes.centerX[i]);
+		const __m128 cy = _mm_loadu_ps(&boxes.centerY[i]);
+		const __m128 cz = _mm_loadu_ps(&boxes.centerZ[i]);
+		const __m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+		const __m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+		const __m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+
+		__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ax[p]), _mm_mul_ps(ey, ay[p])), _mm_mul_ps(ez, az[p]));
+			const __m128 d = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+				_mm_mul_ps(nz[p], cz)), dist[p]);
+			visible = _mm_and_ps(visible, _mm_cmple_ps(_mm_xor_ps(r, signBit), d));
+		}
+		mask[i / 32] |= static_cast<uint32_t>(_mm_movemask_ps(visible)) << (i % 32);
+	}
+#endif
+
+	// whatever doesn't fill a whole register
+	cullAABBsScalar(frustum, boxes, i, count, mask.data());
+}
+#endif
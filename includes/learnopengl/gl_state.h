@@ -0,0 +1,122 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// texture units beyond this are still bound, just never filtered
+#define MAX_TRACKED_TEXTURE_UNITS 32
+
+// shadows the currently bound program, vertex array, active texture unit and 2D texture per unit,
+// so binds that would not change anything never reach the driver.
+// code that binds any of these directly through glad (or deletes an object whose name may be reused)
+// must call invalidate() afterwards, otherwise the shadow copy no longer matches the context. Draws leave their
+// objects bound only within a batch (Model::Draw, RenderQueue::submit, ...), which ends with endBatch().
+class GLState
+{
+public:
+    // number of calls forwarded to GL and number skipped because the state was already set
+    unsigned int issued = 0;
+    unsigned int elided = 0;
+
+    // one tracker per context; this repo only ever creates one
+    static GLState& get()
+    {
+        static GLState state;
+        return state;
+    }
+
+    GLState()
+    {
+        invalidate();
+    }
+
+    void useProgram(unsigned int program)
+    {
+        if (program == currentProgram)
+        {
+            elided++;
+            return;
+        }
+        glUseProgram(program);
+        currentProgram = program;
+        issued++;
+    }
+
+    void bindVertexArray(unsigned int vao)
+    {
+        if (vao == currentVAO)
+        {
+            elided++;
+            return;
+        }
+        glBindVertexArray(vao);
+        currentVAO = vao;
+        issued++;
+    }
+
+    // unit is the index of the texture unit, not GL_TEXTUREi
+    void activeTexture(unsigned int unit)
+    {
+        if (unit == activeUnit)
+        {
+            elided++;
+            return;
+        }
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        issued++;
+    }
+
+    // binds texture to GL_TEXTURE_2D of the given unit, only switching the active unit when the bind is needed
+    void bindTexture2D(unsigned int unit, unsigned int texture)
+    {
+        if (unit < MAX_TRACKED_TEXTURE_UNITS && boundTextures[unit] == texture)
+        {
+            elided++;
+            return;
+        }
+        activeTexture(unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if (unit < MAX_TRACKED_TEXTURE_UNITS)
+            boundTextures[unit] = texture;
+        issued++;
+    }
+
+    // closes a run of draws that bound through the tracker and left their objects bound for each other: unbinds the
+    // vertex array (so direct element buffer binds can't land in a mesh's VAO) and goes back to texture unit 0, as
+    // code outside the run expects, then forgets the rest, since that code may bind without the tracker
+    void endBatch()
+    {
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        invalidate();
+        currentVAO = 0;
+        activeUnit = 0;
+    }
+
+    // forget everything we know about the context; the next bind of each kind is always issued
+    void invalidate()
+    {
+        currentProgram = UNKNOWN;
+        currentVAO = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (unsigned int i = 0; i < MAX_TRACKED_TEXTURE_UNITS; i++)
+            boundTextures[i] = UNKNOWN;
+    }
+
+    void resetCounters()
+    {
+        issued = 0;
+        elided = 0;
+    }
+
+private:
+    // no object has this name, so comparisons against it always fail
+    static const unsigned int UNKNOWN = ~0u;
+
+    unsigned int currentProgram;
+    unsigned int currentVAO;
+    unsigned int activeUnit;
+    unsigned int boundTextures[MAX_TRACKED_TEXTURE_UNITS];
+};
+#endif
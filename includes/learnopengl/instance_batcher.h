@@ -0,0 +1,101 @@
+#ifndef INSTANCE_BATCHER_H
+#define INSTANCE_BATCHER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+
+#include <unordered_map>
+#include <vector>
+
+// groups visible entities by the Model they draw and renders each group with instanced draws,
+// so draw calls scale with the number of unique meshes instead of the number of entities.
+// the shader passed to submit() must read its model matrix from layout (location = INSTANCE_MATRIX_LOCATION) in mat4.
+class InstanceBatcher
+{
+public:
+    // number of draw calls issued by the last submit
+    unsigned int drawCalls = 0;
+
+    InstanceBatcher()
+    {
+        glGenBuffers(1, &instanceBuffer);
+    }
+
+    ~InstanceBatcher()
+    {
+        glDeleteBuffers(1, &instanceBuffer);
+    }
+
+    InstanceBatcher(const InstanceBatcher&) = delete;
+    InstanceBatcher& operator=(const InstanceBatcher&) = delete;
+
+    // forgets the instances of the last frame; batches and their memory are kept for the next one
+    void clear()
+    {
+        for (unsigned int i = 0; i < batches.size(); i++)
+            batches[i].matrices.clear();
+    }
+
+    void push(Model& model, const glm::mat4& modelMatrix)
+    {
+        auto it = batchIndex.find(&model);
+        if (it == batchIndex.end())
+        {
+            it = batchIndex.emplace(&model, static_cast<unsigned int>(batches.size())).first;
+            batches.push_back(Batch());
+            batches.back().model = &model;
+        }
+        batches[it->second].matrices.push_back(modelMatrix);
+    }
+
+    // uploads every queued matrix into the instance buffer in one go, then draws each model once
+    void submit(Shader& shader)
+    {
+        drawCalls = 0;
+        size_t total = 0;
+        for (unsigned int i = 0; i < batches.size(); i++)
+            total += batches[i].matrices.size();
+        if (total == 0)
+            return;
+
+        // orphan the previous frame's storage so the driver doesn't stall on draws still reading it
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, total * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        size_t offset = 0;
+        for (unsigned int i = 0; i < batches.size(); i++)
+        {
+            const std::vector<glm::mat4>& matrices = batches[i].matrices;
+            if (matrices.empty())
+                continue;
+            glBufferSubData(GL_ARRAY_BUFFER, offset, matrices.size() * sizeof(glm::mat4), &matrices[0]);
+            offset += matrices.size() * sizeof(glm::mat4);
+        }
+
+        shader.use();
+        offset = 0;
+        for (unsigned int i = 0; i < batches.size(); i++)
+        {
+            const Batch& batch = batches[i];
+            if (batch.matrices.empty())
+                continue;
+            batch.model->DrawInstanced(shader, instanceBuffer, offset, static_cast<unsigned int>(batch.matrices.size()));
+            drawCalls += static_cast<unsigned int>(batch.model->meshes.size());
+            offset += batch.matrices.size() * sizeof(glm::mat4);
+        }
+    }
+
+private:
+    struct Batch
+    {
+        Model* model;
+        std::vector<glm::mat4> matrices;
+    };
+
+    unsigned int instanceBuffer;
+    std::vector<Batch> batches;
+    std::unordered_map<Model*, unsigned int> batchIndex;
+};
+#endif
@@ -0,0 +1,193 @@
+#pragma once
+
+/* Load-time compression of bone keyframes: key reduction plus quantized key storage, decoded while sampling */
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+/* how far a compressed track may stray from the source keys */
+struct KeyframeCompressionSettings
+{
+	/* distance, in model units */
+	float translationTolerance = 0.001f;
+	/* angle, in radians */
+	float rotationTolerance = 0.001f;
+	/* difference per axis */
+	float scaleTolerance = 0.001f;
+};
+
+/* what compressing a track, bone or clip bought and cost. Errors are measured at every source key time */
+struct KeyframeCompressionStats
+{
+	size_t bytesBefore = 0;
+	size_t bytesAfter = 0;
+	size_t keysBefore = 0;
+	size_t keysAfter = 0;
+	float maxTranslationError = 0.0f;
+	float maxRotationError = 0.0f;
+	float maxScaleError = 0.0f;
+
+	void Merge(const KeyframeCompressionStats& other)
+	{
+		bytesBefore += other.bytesBefore;
+		bytesAfter += other.bytesAfter;
+		keysBefore += other.keysBefore;
+		keysAfter += other.keysAfter;
+		maxTranslationError = std::max(maxTranslationError, other.maxTranslationError);
+		maxRotationError = std::max(maxRotationError, other.maxRotationError);
+		maxScaleError = std::max(maxScaleError, other.maxScaleError);
+	}
+};
+
+/* vec3 key stored as 16 bits per axis, scaled to the range of its track */
+struct PackedKeyVec3
+{
+	uint16_t value[3];
+	float timeStamp;
+};
+
+/* quaternion key in 48 bits, smallest three: the three smaller components at 15 bits each, plus which one was dropped */
+struct PackedKeyQuat
+{
+	uint16_t value[3];
+	float timeStamp;
+};
+
+/* per track bounds a PackedKeyVec3 is scaled to */
+struct QuantizationRange
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 extent = glm::vec3(0.0f);
+
+	static QuantizationRange Of(const std::vector<glm::vec3>& values)
+	{
+		QuantizationRange range;
+		if (values.empty())
+			return range;
+		glm::vec3 max = values[0];
+		range.min = values[0];
+		for (const glm::vec3& value : values)
+		{
+			range.min = glm::min(range.min, value);
+			max = glm::max(max, value);
+		}
+		range.extent = max - range.min;
+		return range;
+	}
+
+	void Encode(const glm::vec3& value, uint16_t packed[3]) const
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float normalized = extent[axis] > 0.0f ? (value[axis] - min[axis]) / extent[axis] : 0.0f;
+			packed[axis] = static_cast<uint16_t>(std::lround(glm::clamp(normalized, 0.0f, 1.0f) * 65535.0f));
+		}
+	}
+
+	glm::vec3 Decode(const uint16_t packed[3]) const
+	{
+		const float scale = 1.0f / 65535.0f;
+		return min + extent * glm::vec3(packed[0] * scale, packed[1] * scale, packed[2] * scale);
+	}
+};
+
+/* the three smaller components of a unit quaternion all lie within +-1/sqrt(2) */
+#define SMALLEST_THREE_RANGE 0.70710678f
+
+inline void EncodeQuat(const glm::quat& rotation, uint16_t packed[3])
+{
+	const glm::quat q = glm::normalize(rotation);
+	float components[4] = { q.x, q.y, q.z, q.w };
+
+	int largest = 0;
+	for (int i = 1; i < 4; i++)
+		if (std::abs(components[i]) > std::abs(components[largest]))
+			largest = i;
+	// q and -q are the same rotation, pick the one whose dropped component is positive
+	const float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	int slot = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		const float normalized = (components[i] * sign / SMALLEST_THREE_RANGE) * 0.5f + 0.5f;
+		packed[slot++] = static_cast<uint16_t>(std::lround(glm::clamp(normalized, 0.0f, 1.0f) * 32767.0f));
+	}
+	// index of the dropped component goes in the spare top bits of the first two words
+	packed[0] |= static_cast<uint16_t>((largest & 1) << 15);
+	packed[1] |= static_cast<uint16_t>((largest >> 1) << 15);
+}
+
+inline glm::quat DecodeQuat(const uint16_t packed[3])
+{
+	const int largest = (packed[0] >> 15) | ((packed[1] >> 15) << 1);
+	const float scale = 2.0f * SMALLEST_THREE_RANGE / 32767.0f;
+
+	float components[4];
+	float sumOfSquares = 0.0f;
+	int slot = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		components[i] = (packed[slot++] & 0x7fff) * scale - SMALLEST_THREE_RANGE;
+		sumOfSquares += components[i] * components[i];
+	}
+	components[largest] = std::sqrt(std::max(0.0f, 1.0f - sumOfSquares));
+	return glm::quat(components[3], components[0], components[1], components[2]);
+}
+
+/* angle between two rotations, in radians. atan2 of the difference rotation rather than acos of a dot product,
+which loses most of its precision at the small angles compression errors live at */
+inline float QuatAngle(const glm::quat& a, const glm::quat& b)
+{
+	const glm::quat difference = glm::conjugate(glm::normalize(a)) * glm::normalize(b);
+	return 2.0f * std::atan2(glm::length(glm::vec3(difference.x, difference.y, difference.z)), std::abs(difference.w));
+}
+
+/* indices of the keys to keep so that interpolating between kept keys reproduces every dropped one within tolerance.
+The first and last keys always stay, a constant track keeps only its first. Greedy: each segment grows until the
+next key would break tolerance. lerp(a, b, factor) interpolates two values, error(a, b) measures how far apart they are */
+template<typename Value, typename Lerp, typename Error>
+std::vector<int> ReduceKeys(const std::vector<float>& times, const std::vector<Value>& values, float tolerance,
+	Lerp lerp, Error error)
+{
+	std::vector<int> kept;
+	const int count = static_cast<int>(values.size());
+	if (count == 0)
+		return kept;
+	kept.push_back(0);
+
+	bool constant = true;
+	for (int i = 1; i < count && constant; i++)
+		constant = error(values[i], values[0]) <= tolerance;
+	if (constant)
+		return kept;
+
+	int start = 0;
+	while (start < count - 1)
+	{
+		int end = start + 1;
+		while (end + 1 < count)
+		{
+			const int candidate = end + 1;
+			bool fits = true;
+			for (int i = start + 1; i < candidate && fits; i++)
+			{
+				const float factor = (times[i] - times[start]) / (times[candidate] - times[start]);
+				fits = error(lerp(values[start], values[candidate], factor), values[i]) <= tolerance;
+			}
+			if (!fits)
+				break;
+			end = candidate;
+		}
+		kept.push_back(end);
+		start = end;
+	}
+	return kept;
+}
@@ -7,12 +7,19 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/vertex_layout.h>
 
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
 #define MAX_BONE_INFLUENCE 4
+// first of the four attribute locations holding the per-instance model matrix (one vec4 column each)
+#define INSTANCE_MATRIX_LOCATION 7
 
 struct Vertex {
     // position
@@ -37,6 +44,13 @@ struct Texture {
     string path;
 };
 
+// a texture of the mesh resolved against one shader program: which unit it goes to and which sampler uniform reads it
+struct SamplerBinding {
+    int unit;
+    int location;
+    unsigned int texture;
+};
+
 class Mesh {
 public:
     // mesh Data
@@ -44,29 +58,143 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
+    // how the vertices and indices are laid out in the GL buffers, chosen from the VertexFormat at construction
+    VertexLayout layout;
 
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // constructor. The vectors are taken over, not copied, when the caller passes them with std::move. With
+    // createBuffers false no GL call is made, so the mesh can be built on any thread; upload() then creates its
+    // buffers on the GL thread. format picks the encoding of the GL buffers; the vectors keep full precision.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool createBuffers = true, const VertexFormat &format = VertexFormat())
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->layout = chooseLayout(format);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
+        if(createBuffers)
+            this->upload();
+    }
+
+    // constructor from arrays already in memory, such as the ones mapped from a model cache. They're copied once,
+    // straight into the mesh, without building intermediate vectors
+    Mesh(const Vertex *vertexData, unsigned int vertexCount, const unsigned int *indexData, unsigned int indexCount, vector<Texture> textures, bool createBuffers = true, const VertexFormat &format = VertexFormat())
+    {
+        this->vertices.assign(vertexData, vertexData + vertexCount);
+        this->indices.assign(indexData, indexData + indexCount);
+        this->textures = std::move(textures);
+        this->layout = chooseLayout(format);
+
+        if(createBuffers)
+            this->upload();
+    }
+
+    // creates the vertex array and buffers, once. GL thread only
+    void upload()
+    {
+        if(resident)
+            return;
         setupMesh();
+        resident = true;
+    }
+
+    // whether the GL objects exist, i.e. the mesh can be drawn
+    bool isResident() const
+    {
+        return resident;
+    }
+
+    // bytes upload() sends to the GPU
+    size_t uploadSize() const
+    {
+        return vertices.size() * layout.stride + indices.size() * layout.indexSize();
+    }
+
+    // render the mesh, leaving the GL state as it found it apart from the program and texture bindings
+    void Draw(Shader &shader)
+    {
+        drawBatched(shader);
+        GLState::get().endBatch();
+    }
+
+    // render count instances of the mesh in one call. Their model matrices are read from instanceBuffer starting at
+    // byte offset, and reach the vertex shader as layout (location = INSTANCE_MATRIX_LOCATION) in mat4.
+    void DrawInstanced(Shader &shader, unsigned int instanceBuffer, size_t offset, unsigned int count)
+    {
+        drawInstancedBatched(shader, instanceBuffer, offset, count);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        GLState::get().endBatch();
+    }
+
+    // Draw for one mesh of a batch: the VAO and textures are left bound so the next mesh can skip binding them again.
+    // whoever runs the batch calls GLState::get().endBatch() after its last draw
+    void drawBatched(Shader &shader)
+    {
+        bindTextures(shader);
+        GLState::get().bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), layout.indexType, 0);
     }
 
-    // render the mesh
-    void Draw(Shader &shader) 
+    // DrawInstanced within a batch, which also leaves instanceBuffer bound to GL_ARRAY_BUFFER
+    void drawInstancedBatched(Shader &shader, unsigned int instanceBuffer, size_t offset, unsigned int count)
     {
-        // bind appropriate textures
+        bindTextures(shader);
+
+        GLState::get().bindVertexArray(instanceVAO);
+        // GL 3.3 has no base instance, so point the matrix attributes at this batch's slice of the buffer
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for(unsigned int i = 0; i < 4; i++)
+            glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + i * sizeof(glm::vec4)));
+        glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), layout.indexType, 0, count);
+    }
+
+private:
+    // render data 
+    unsigned int VBO, EBO;
+    // same buffers as VAO plus the per-instance matrix attributes
+    unsigned int instanceVAO;
+    bool resident = false;
+
+    // binds every texture of the mesh to the unit its sampler in the shader expects
+    void bindTextures(Shader &shader)
+    {
+        GLState& state = GLState::get();
+        const vector<SamplerBinding>& bindings = getSamplerBindings(shader);
+        for(unsigned int i = 0; i < bindings.size(); i++)
+        {
+            // set the sampler to the correct texture unit
+            glUniform1i(bindings[i].location, bindings[i].unit);
+            // and bind the texture, skipped when consecutive meshes share it
+            state.bindTexture2D(bindings[i].unit, bindings[i].texture);
+        }
+    }
+
+    // sampler bindings resolved per shader program the mesh has been drawn with
+    struct SamplerTable {
+        unsigned int program;
+        vector<SamplerBinding> bindings;
+    };
+    vector<SamplerTable> samplerTables;
+
+    // returns the sampler bindings for the given shader, resolving them the first time the mesh is drawn with it.
+    // we assume a convention for sampler names in the shaders: texture_diffuseN, texture_specularN, texture_normalN
+    // and texture_heightN, where N is a sequential number per texture type starting at 1.
+    const vector<SamplerBinding>& getSamplerBindings(const Shader &shader)
+    {
+        for(unsigned int i = 0; i < samplerTables.size(); i++)
+        {
+            if(samplerTables[i].program == shader.ID)
+                return samplerTables[i].bindings;
+        }
+
+        SamplerTable table;
+        table.program = shader.ID;
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -79,68 +207,243 @@ public:
              else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to string
 
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            SamplerBinding binding;
+            binding.unit = i;
+            binding.location = glGetUniformLocation(shader.ID, (name + number).c_str());
+            binding.texture = textures[i].id;
+            table.bindings.push_back(binding);
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        samplerTables.push_back(table);
+        return samplerTables.back().bindings;
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
-
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
+        glGenVertexArrays(1, &instanceVAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        GLState::get().bindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+        if(!layout.packed)
+        {
+            // A great thing about structs is that their memory layout is sequential for all its items.
+            // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+            // again translates to 3/2 floats which translates to a byte array.
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        }
+        else
+        {
+            vector<unsigned char> packed = packVertices();
+            glBufferData(GL_ARRAY_BUFFER, packed.size(), &packed[0], GL_STATIC_DRAW);
+        }
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if(layout.indexType == GL_UNSIGNED_SHORT)
+        {
+            vector<unsigned short> shortIndices(indices.begin(), indices.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(unsigned short), &shortIndices[0], GL_STATIC_DRAW);
+        }
+        else
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+
+        setupVertexAttributes();
 
+        // the instanced path shares the vertex and index buffers and adds a mat4 that advances once per instance.
+        // its pointers are set by DrawInstanced, since the instance buffer changes every frame.
+        GLState::get().bindVertexArray(instanceVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-		// ids
-		glEnableVertexAttribArray(5);
-		glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-		// weights
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+        setupVertexAttributes();
+        for(unsigned int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + i);
+            glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + i, 1);
+        }
+        GLState::get().bindVertexArray(0);
+    }
+
+    // set the vertex attribute pointers of the bound VAO to the layout of the bound GL_ARRAY_BUFFER
+    void setupVertexAttributes()
+    {
+        for(unsigned int i = 0; i < layout.attributes.size(); i++)
+        {
+            const VertexAttribute &attribute = layout.attributes[i];
+            glEnableVertexAttribArray(attribute.location);
+            if(attribute.integer)
+                glVertexAttribIPointer(attribute.location, attribute.components, attribute.type, layout.stride, (void*)(size_t)attribute.offset);
+            else
+                glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized, layout.stride, (void*)(size_t)attribute.offset);
+        }
+    }
+
+    // the layout format asks for, narrowed to what this mesh's data allows
+    VertexLayout chooseLayout(const VertexFormat &format) const
+    {
+        VertexLayout layout;
+        layout.indexType = format.shortIndices && vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        if(!format.octahedralNormals && format.texCoords == TEXCOORD_FLOAT && !format.compactSkinning)
+        {
+            // the Vertex struct itself
+            layout.add(VERTEX_POSITION, 0, 3, GL_FLOAT, GL_FALSE);
+            layout.add(VERTEX_NORMAL, 1, 3, GL_FLOAT, GL_FALSE);
+            layout.add(VERTEX_TEXCOORDS, 2, 2, GL_FLOAT, GL_FALSE);
+            layout.add(VERTEX_TANGENT, 3, 3, GL_FLOAT, GL_FALSE);
+            layout.add(VERTEX_BITANGENT, 4, 3, GL_FLOAT, GL_FALSE);
+            layout.add(VERTEX_BONE_IDS, 5, 4, GL_INT, GL_FALSE, true);
+            layout.add(VERTEX_BONE_WEIGHTS, 6, 4, GL_FLOAT, GL_FALSE);
+            layout.attributes[1].offset = offsetof(Vertex, Normal);
+            layout.attributes[2].offset = offsetof(Vertex, TexCoords);
+            layout.attributes[3].offset = offsetof(Vertex, Tangent);
+            layout.attributes[4].offset = offsetof(Vertex, Bitangent);
+            layout.attributes[5].offset = offsetof(Vertex, m_BoneIDs);
+            layout.attributes[6].offset = offsetof(Vertex, m_Weights);
+            layout.stride = sizeof(Vertex);
+            return layout;
+        }
+
+        // what the vertices hold decides how small some attributes can get
+        bool texCoordsInUnitRange = true;
+        bool skinned = false;
+        int maxBoneID = 0;
+        for(unsigned int i = 0; i < vertices.size(); i++)
+        {
+            const glm::vec2 &uv = vertices[i].TexCoords;
+            if(uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f)
+                texCoordsInUnitRange = false;
+            for(int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            {
+                if(vertices[i].m_Weights[j] > 0.0f)
+                {
+                    skinned = true;
+                    maxBoneID = std::max(maxBoneID, vertices[i].m_BoneIDs[j]);
+                }
+            }
+        }
+
+        layout.packed = true;
+        layout.add(VERTEX_POSITION, 0, 3, GL_FLOAT, GL_FALSE);
+        if(format.octahedralNormals)
+            layout.add(VERTEX_NORMAL, 1, 2, GL_SHORT, GL_TRUE);
+        else
+            layout.add(VERTEX_NORMAL, 1, 3, GL_FLOAT, GL_FALSE);
+
+        TexCoordEncoding texCoords = format.texCoords;
+        if(texCoords == TEXCOORD_UNORM16 && !texCoordsInUnitRange)
+            texCoords = TEXCOORD_HALF;
+        if(texCoords == TEXCOORD_UNORM16)
+            layout.add(VERTEX_TEXCOORDS, 2, 2, GL_UNSIGNED_SHORT, GL_TRUE);
+        else if(texCoords == TEXCOORD_HALF)
+            layout.add(VERTEX_TEXCOORDS, 2, 2, GL_HALF_FLOAT, GL_FALSE);
+        else
+            layout.add(VERTEX_TEXCOORDS, 2, 2, GL_FLOAT, GL_FALSE);
+
+        if(format.octahedralNormals)
+            layout.add(VERTEX_TANGENT, 3, 3, GL_SHORT, GL_TRUE);
+        else
+        {
+            layout.add(VERTEX_TANGENT, 3, 3, GL_FLOAT, GL_FALSE);
+            layout.add(VERTEX_BITANGENT, 4, 3, GL_FLOAT, GL_FALSE);
+        }
+
+        if(!format.compactSkinning)
+        {
+            layout.add(VERTEX_BONE_IDS, 5, 4, GL_INT, GL_FALSE, true);
+            layout.add(VERTEX_BONE_WEIGHTS, 6, 4, GL_FLOAT, GL_FALSE);
+        }
+        else if(skinned)
+        {
+            layout.add(VERTEX_BONE_IDS, 5, 4, maxBoneID < 256 ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT, GL_FALSE, true);
+            layout.add(VERTEX_BONE_WEIGHTS, 6, 4, GL_UNSIGNED_BYTE, GL_TRUE);
+        }
+        return layout;
+    }
+
+    // the vertices encoded as layout describes, for a packed layout
+    vector<unsigned char> packVertices() const
+    {
+        vector<unsigned char> data(vertices.size() * layout.stride);
+        for(unsigned int i = 0; i < vertices.size(); i++)
+        {
+            const Vertex &vertex = vertices[i];
+            unsigned char *out = &data[i * layout.stride];
+            for(unsigned int j = 0; j < layout.attributes.size(); j++)
+                packAttribute(vertex, layout.attributes[j], out + layout.attributes[j].offset);
+        }
+        return data;
+    }
+
+    static void packAttribute(const Vertex &vertex, const VertexAttribute &attribute, unsigned char *out)
+    {
+        switch(attribute.semantic)
+        {
+            case VERTEX_POSITION:
+                memcpy(out, &vertex.Position, sizeof(glm::vec3));
+                break;
+            case VERTEX_NORMAL:
+                if(attribute.type == GL_FLOAT)
+                    memcpy(out, &vertex.Normal, sizeof(glm::vec3));
+                else
+                    storePacked(out, glm::packSnorm2x16(octahedralEncode(vertex.Normal)));
+                break;
+            case VERTEX_TEXCOORDS:
+                if(attribute.type == GL_FLOAT)
+                    memcpy(out, &vertex.TexCoords, sizeof(glm::vec2));
+                else if(attribute.type == GL_HALF_FLOAT)
+                    storePacked(out, glm::packHalf2x16(vertex.TexCoords));
+                else
+                    storePacked(out, glm::packUnorm2x16(vertex.TexCoords));
+                break;
+            case VERTEX_TANGENT:
+                if(attribute.type == GL_FLOAT)
+                    memcpy(out, &vertex.Tangent, sizeof(glm::vec3));
+                else
+                {
+                    // the bitangent is rebuilt as cross(normal, tangent) times this sign
+                    const float sign = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+                    storePacked(out, glm::packSnorm2x16(octahedralEncode(vertex.Tangent)));
+                    const unsigned short packedSign = glm::packSnorm1x16(sign);
+                    memcpy(out + 4, &packedSign, sizeof(packedSign));
+                }
+                break;
+            case VERTEX_BITANGENT:
+                memcpy(out, &vertex.Bitangent, sizeof(glm::vec3));
+                break;
+            case VERTEX_BONE_IDS:
+                if(attribute.type == GL_INT)
+                    memcpy(out, vertex.m_BoneIDs, sizeof(vertex.m_BoneIDs));
+                else
+                {
+                    // empty slots (-1) become bone 0, which their zero weight cancels
+                    for(int i = 0; i < MAX_BONE_INFLUENCE; i++)
+                    {
+                        const int id = std::max(vertex.m_BoneIDs[i], 0);
+                        if(attribute.type == GL_UNSIGNED_BYTE)
+                            out[i] = static_cast<unsigned char>(id);
+                        else
+                        {
+                            const unsigned short shortID = static_cast<unsigned short>(id);
+                            memcpy(out + i * sizeof(shortID), &shortID, sizeof(shortID));
+                        }
+                    }
+                }
+                break;
+            case VERTEX_BONE_WEIGHTS:
+                if(attribute.type == GL_FLOAT)
+                    memcpy(out, vertex.m_Weights, sizeof(vertex.m_Weights));
+                else
+                    storePacked(out, packBoneWeights(vertex.m_Weights));
+                break;
+        }
+    }
+
+    static void storePacked(unsigned char *out, uint32_t value)
+    {
+        memcpy(out, &value, sizeof(value));
     }
 };
 #endif
@@ -12,12 +12,17 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/model_cache.h>
+#include <learnopengl/texture_cache.h>
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
@@ -27,28 +32,130 @@ class Model
 {
 public:
     // model data 
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Texture> textures_loaded;	// stores all the textures loaded so far, one reference each in the TextureCache.
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // true when the meshes came from the cache instead of being imported by ASSIMP
+    bool loadedFromCache = false;
+    // true while a ModelStreamer is still uploading meshes or textures; Draw shows the meshes uploaded so far
+    bool streaming = false;
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // constructor, expects a filepath to a 3D model. With useCache the imported meshes are also written to a binary
+    // cache next to the model (path + ".model.cache"), which later runs map and load instead of importing again
+    // for as long as the model file is unchanged. With a texturePool, textures are decoded on its threads while the
+    // meshes are built and uploaded as they finish; otherwise each one is decoded and uploaded in turn.
+    // vertexFormat chooses how compactly each mesh's vertices and indices are stored on the GPU, see VertexFormat.
+    Model(string const &path, bool gamma = false, bool useCache = true, ThreadPool *texturePool = NULL, const VertexFormat &vertexFormat = VertexFormat()) : gammaCorrection(gamma), vertexFormat(vertexFormat)
     {
-        loadModel(path);
+        if(texturePool)
+        {
+            TextureLoader loader(*texturePool);
+            textureLoader = &loader;
+            loadModel(path, useCache);
+            loader.finish();
+            textureLoader = NULL;
+        }
+        else
+            loadModel(path, useCache);
+    }
+
+    // a copy shares the meshes' GL objects and the textures, holding a reference of its own on each texture so every
+    // copy can releaseTextures() independently
+    Model(const Model &other)
+        : textures_loaded(other.textures_loaded), meshes(other.meshes), directory(other.directory),
+          gammaCorrection(other.gammaCorrection), loadedFromCache(other.loadedFromCache), streaming(other.streaming),
+          vertexFormat(other.vertexFormat), loadedTextureIndex(other.loadedTextureIndex)
+    {
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+            TextureCache::get().retain(textures_loaded[i].id);
+    }
+
+    // a move hands the references over, leaving other without textures
+    Model(Model &&other) = default;
+
+    // releases the textures held so far (see releaseTextures) and takes references on other's
+    Model& operator=(const Model &other)
+    {
+        if(this == &other)
+            return *this;
+        for(unsigned int i = 0; i < other.textures_loaded.size(); i++)
+            TextureCache::get().retain(other.textures_loaded[i].id);
+        releaseTextures();
+        textures_loaded = other.textures_loaded;
+        meshes = other.meshes;
+        directory = other.directory;
+        gammaCorrection = other.gammaCorrection;
+        loadedFromCache = other.loadedFromCache;
+        streaming = other.streaming;
+        vertexFormat = other.vertexFormat;
+        loadedTextureIndex = other.loadedTextureIndex;
+        return *this;
+    }
+
+    // gives the model's textures back to the TextureCache, which deletes those no other model uses. Call it while
+    // the GL context is still current; the meshes can't be drawn with their textures afterwards.
+    void releaseTextures()
+    {
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+            TextureCache::get().release(textures_loaded[i].id);
+        textures_loaded.clear();
+        loadedTextureIndex.clear();
     }
 
     // draws the model, and thus all its meshes
     void Draw(Shader &shader)
+    {
+        // the meshes share one batch, so bindings carry over between them but not out of the model
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].drawBatched(shader);
+        GLState::get().endBatch();
+    }
+
+    // draws count instances of the model, their model matrices read from instanceBuffer starting at byte offset
+    void DrawInstanced(Shader &shader, unsigned int instanceBuffer, size_t offset, unsigned int count)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].drawInstancedBatched(shader, instanceBuffer, offset, count);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        GLState::get().endBatch();
     }
     
 private:
+    friend class ModelStreamer;
+
+    // set while the constructor loads with a texture pool, or while a ModelStreamer uploads the model
+    TextureLoader *textureLoader = NULL;
+    // building off the GL thread for a ModelStreamer: meshes get no buffers, textures are only noted by path
+    bool deferUpload = false;
+    // encoding of the GL buffers of every mesh
+    VertexFormat vertexFormat;
+
+    // empty model for ModelStreamer to fill
+    Model() : gammaCorrection(false) {}
+
+    // takes what a model built for streaming knows besides its meshes
+    void adoptStaged(const Model &staged)
+    {
+        directory = staged.directory;
+        loadedFromCache = staged.loadedFromCache;
+    }
+    // position of each texture path in textures_loaded
+    unordered_map<string, unsigned int> loadedTextureIndex;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+    void loadModel(string const &path, bool useCache)
     {
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        const string cachePath = path + ".model.cache";
+        if(useCache && loadCache(cachePath, path))
+        {
+            loadedFromCache = true;
+            return;
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -58,11 +165,41 @@ private:
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
+        // one mesh per node reference; most scenes reference each of their meshes once
+        meshes.reserve(scene->mNumMeshes);
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+
+        if(useCache)
+            saveCache(cachePath, path);
+    }
+
+    // the cache holds every mesh's vertices and indices as they are in memory, plus the paths of their textures
+    void saveCache(string const &cachePath, string const &path)
+    {
+        CacheWriter writer("LGMC", path);
+        writeCachedMeshes(writer, meshes);
+        writer.save(cachePath);
+    }
+
+    // builds the meshes from a current cache, validating all of it before creating any GL object
+    bool loadCache(string const &cachePath, string const &path)
+    {
+        CacheReader reader;
+        vector<CachedMesh> cached;
+        if(!reader.open(cachePath, "LGMC", path) || !readCachedMeshes(reader, cached))
+            return false;
+
+        meshes.reserve(cached.size());
+        for(unsigned int i = 0; i < cached.size(); i++)
+        {
+            vector<Texture> textures;
+            for(unsigned int j = 0; j < cached[i].textures.size(); j++)
+                textures.push_back(loadTexture(cached[i].textures[j].path.c_str(), cached[i].textures[j].type));
+            meshes.push_back(Mesh(cached[i].vertices, cached[i].vertexCount, cached[i].indices, cached[i].indexCount, textures, !deferUpload, vertexFormat));
+        }
+        return true;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -86,61 +223,52 @@ private:
 
     Mesh processMesh(aiMesh *mesh, const aiScene *scene)
     {
-        // data to fill
-        vector<Vertex> vertices;
+        // data to fill. The vertices are sized up front and filled one attribute at a time, so every loop below is a
+        // straight copy out of one of ASSIMP's arrays, without per-vertex branches or reallocations
+        const unsigned int vertexCount = mesh->mNumVertices;
+        vector<Vertex> vertices(vertexCount);
         vector<unsigned int> indices;
         vector<Texture> textures;
 
-        // walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
+        // positions
+        for(unsigned int i = 0; i < vertexCount; i++)
+            vertices[i].Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        // normals
+        if(mesh->HasNormals())
         {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            if (mesh->HasNormals())
-            {
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
-            }
-            // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+            for(unsigned int i = 0; i < vertexCount; i++)
+                vertices[i].Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+        }
+        // texture coordinates, left at zero when the mesh has none
+        if(mesh->mTextureCoords[0])
+        {
+            // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
+            // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
+            const aiVector3D *texCoords = mesh->mTextureCoords[0];
+            for(unsigned int i = 0; i < vertexCount; i++)
+                vertices[i].TexCoords = glm::vec2(texCoords[i].x, texCoords[i].y);
+        }
+        // tangents and bitangents, which aiProcess_CalcTangentSpace derives from the texture coordinates
+        if(mesh->HasTangentsAndBitangents())
+        {
+            for(unsigned int i = 0; i < vertexCount; i++)
             {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x; 
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-                // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
+                vertices[i].Tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+                vertices[i].Bitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
             }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
         }
-        // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        // now walk through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        // faces are counted first so the indices are allocated once, at their exact size
+        unsigned int indexCount = 0;
+        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+            indexCount += mesh->mFaces[i].mNumIndices;
+        indices.resize(indexCount);
+        unsigned int *index = indices.data();
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
-            // retrieve all indices of the face and store them in the indices vector
-            for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);        
+            const aiFace &face = mesh->mFaces[i];
+            std::copy(face.mIndices, face.mIndices + face.mNumIndices, index);
+            index += face.mNumIndices;
         }
         // process materials
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
@@ -164,8 +292,8 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return a mesh object created from the extracted mesh data, handing it the buffers rather than copies
+        return Mesh(std::move(vertices), std::move(indices), std::move(textures), !deferUpload, vertexFormat);
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -177,29 +305,36 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // returns the texture at path (relative to the model's directory), loading it unless it was loaded before
+    Texture loadTexture(const char *path, string const &typeName)
+    {
+        if(deferUpload)
+        {
+            // acquired once the mesh reaches the GL thread, see ModelStreamer
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = path;
+            return texture;
+        }
+        // check if the model uses the texture already and if so, skip acquiring it again
+        unordered_map<string, unsigned int>::iterator found = loadedTextureIndex.find(path);
+        if(found != loadedTextureIndex.end())
+            return textures_loaded[found->second];
+        // if not, get it from the process-wide cache, which only loads it if no other model did
+        Texture texture;
+        texture.id = TextureCache::get().acquire(this->directory + '/' + path, false, 0, textureLoader);
+        texture.type = typeName;
+        texture.path = path;
+        loadedTextureIndex[texture.path] = static_cast<unsigned int>(textures_loaded.size());
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+        return texture;
+    }
 };
 
 
@@ -211,34 +346,8 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    DecodedImage image = decodeImage(filename);
+    uploadImage(textureID, image);
 
     return textureID;
 }
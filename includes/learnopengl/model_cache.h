@@ -0,0 +1,348 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/animdata.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// bump whenever the layout of a cache file, or of anything stored in it as raw bytes (Vertex, the key structs),
+// changes. Files written by another version are ignored and rewritten
+#define MODEL_CACHE_VERSION 1
+// arrays are padded to this so they can be used in place from the mapped file
+#define MODEL_CACHE_ALIGNMENT 16
+
+// starts every cache file. The source's size and modification time tell whether the cache is still up to date
+struct CacheFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t reserved;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+};
+
+// size and modification time of the file at path, false if it can't be read
+inline bool cacheSourceStamp(const std::string &path, uint64_t &size, int64_t &time)
+{
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0)
+        return false;
+    size = static_cast<uint64_t>(info.st_size);
+    time = static_cast<int64_t>(info.st_mtime);
+    return true;
+}
+
+// read-only mapping of a whole file, unmapped when destroyed
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if(GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+        {
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if(mapping)
+                bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            length = bytes ? static_cast<size_t>(fileSize.QuadPart) : 0;
+        }
+        CloseHandle(file);
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if(file < 0)
+            return false;
+        struct stat info;
+        if(fstat(file, &info) == 0 && info.st_size > 0)
+        {
+            void *view = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+            if(view != MAP_FAILED)
+            {
+                bytes = static_cast<const char*>(view);
+                length = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(file);
+#endif
+        if(!bytes)
+            close();
+        return bytes != NULL;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if(bytes)
+            UnmapViewOfFile(bytes);
+        if(mapping)
+            CloseHandle(mapping);
+        mapping = NULL;
+#else
+        if(bytes)
+            munmap(const_cast<char*>(bytes), length);
+#endif
+        bytes = NULL;
+        length = 0;
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char *bytes = NULL;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE mapping = NULL;
+#endif
+};
+
+// builds a cache file in memory, then writes it out in one go
+class CacheWriter
+{
+public:
+    CacheWriter(const char magic[4], const std::string &sourcePath)
+    {
+        CacheFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = MODEL_CACHE_VERSION;
+        header.vertexSize = sizeof(Vertex);
+        valid = cacheSourceStamp(sourcePath, header.sourceSize, header.sourceTime);
+        write(header);
+    }
+
+    template<typename T>
+    void write(const T &value)
+    {
+        const char *first = reinterpret_cast<const char*>(&value);
+        bytes.insert(bytes.end(), first, first + sizeof(T));
+    }
+
+    // count values of a plain type as raw bytes, aligned so a reader can use them in place
+    template<typename T>
+    void writeArray(const T *values, size_t count)
+    {
+        bytes.resize((bytes.size() + MODEL_CACHE_ALIGNMENT - 1) / MODEL_CACHE_ALIGNMENT * MODEL_CACHE_ALIGNMENT, 0);
+        const char *first = reinterpret_cast<const char*>(values);
+        if(count > 0)
+            bytes.insert(bytes.end(), first, first + count * sizeof(T));
+    }
+
+    void writeString(const std::string &value)
+    {
+        write(static_cast<uint32_t>(value.size()));
+        bytes.insert(bytes.end(), value.begin(), value.end());
+    }
+
+    // writes to a temporary file first and renames it over path, so a reader never maps a half written cache
+    bool save(const std::string &path) const
+    {
+        if(!valid)
+            return false;
+        const std::string temporary = path + ".tmp";
+        FILE *file = fopen(temporary.c_str(), "wb");
+        if(!file)
+            return false;
+        const bool written = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        if(fclose(file) != 0 || !written)
+        {
+            remove(temporary.c_str());
+            return false;
+        }
+        remove(path.c_str());
+        return rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    std::vector<char> bytes;
+    bool valid;
+};
+
+// walks a mapped cache file front to back. Every read checks the bounds of the file, so a truncated or corrupt
+// cache fails to load instead of crashing; arrays come back as pointers into the mapping, valid while the reader lives
+class CacheReader
+{
+public:
+    // maps path and checks that it's a current cache of sourcePath with the given magic
+    bool open(const std::string &path, const char magic[4], const std::string &sourcePath)
+    {
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        if(!cacheSourceStamp(sourcePath, sourceSize, sourceTime) || !file.open(path))
+            return false;
+        cursor = 0;
+        CacheFileHeader header;
+        if(!read(header))
+            return false;
+        return memcmp(header.magic, magic, sizeof(header.magic)) == 0 && header.version == MODEL_CACHE_VERSION &&
+            header.vertexSize == sizeof(Vertex) && header.sourceSize == sourceSize && header.sourceTime == sourceTime;
+    }
+
+    template<typename T>
+    bool read(T &value)
+    {
+        if(file.size() - cursor < sizeof(T))
+            return false;
+        memcpy(&value, file.data() + cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+
+    // the next count values written by CacheWriter::writeArray, NULL if the file is too short
+    template<typename T>
+    const T* readArray(size_t count)
+    {
+        const size_t start = (cursor + MODEL_CACHE_ALIGNMENT - 1) / MODEL_CACHE_ALIGNMENT * MODEL_CACHE_ALIGNMENT;
+        if(start > file.size() || (file.size() - start) / sizeof(T) < count)
+            return NULL;
+        cursor = start + count * sizeof(T);
+        return reinterpret_cast<const T*>(file.data() + start);
+    }
+
+    bool readString(std::string &value)
+    {
+        uint32_t length;
+        if(!read(length) || file.size() - cursor < length)
+            return false;
+        value.assign(file.data() + cursor, length);
+        cursor += length;
+        return true;
+    }
+
+private:
+    MappedFile file;
+    size_t cursor = 0;
+};
+
+// a texture a cached mesh refers to, loaded again from its path
+struct CachedTexture
+{
+    string type;
+    string path;
+};
+
+// a mesh as stored in the cache: vertices and indices point into the mapped file
+struct CachedMesh
+{
+    const Vertex *vertices;
+    uint32_t vertexCount;
+    const unsigned int *indices;
+    uint32_t indexCount;
+    vector<CachedTexture> textures;
+};
+
+inline void writeCachedMeshes(CacheWriter &writer, const vector<Mesh> &meshes)
+{
+    writer.write(static_cast<uint32_t>(meshes.size()));
+    for(unsigned int i = 0; i < meshes.size(); i++)
+    {
+        const Mesh &mesh = meshes[i];
+        writer.write(static_cast<uint32_t>(mesh.vertices.size()));
+        writer.write(static_cast<uint32_t>(mesh.indices.size()));
+        writer.write(static_cast<uint32_t>(mesh.textures.size()));
+        for(unsigned int j = 0; j < mesh.textures.size(); j++)
+        {
+            writer.writeString(mesh.textures[j].type);
+            writer.writeString(mesh.textures[j].path);
+        }
+        writer.writeArray(mesh.vertices.data(), mesh.vertices.size());
+        writer.writeArray(mesh.indices.data(), mesh.indices.size());
+    }
+}
+
+inline bool readCachedMeshes(CacheReader &reader, vector<CachedMesh> &meshes)
+{
+    uint32_t meshCount;
+    if(!reader.read(meshCount))
+        return false;
+    meshes.clear();
+    for(uint32_t i = 0; i < meshCount; i++)
+    {
+        CachedMesh mesh;
+        uint32_t textureCount;
+        if(!reader.read(mesh.vertexCount) || !reader.read(mesh.indexCount) || !reader.read(textureCount))
+            return false;
+        for(uint32_t j = 0; j < textureCount; j++)
+        {
+            CachedTexture texture;
+            if(!reader.readString(texture.type) || !reader.readString(texture.path))
+                return false;
+            mesh.textures.push_back(texture);
+        }
+        mesh.vertices = reader.readArray<Vertex>(mesh.vertexCount);
+        mesh.indices = reader.readArray<unsigned int>(mesh.indexCount);
+        if(!mesh.vertices || !mesh.indices)
+            return false;
+        // indices past the end of the vertices would have the GPU read out of bounds
+        for(uint32_t j = 0; j < mesh.indexCount; j++)
+            if(mesh.indices[j] >= mesh.vertexCount)
+                return false;
+        meshes.push_back(mesh);
+    }
+    return true;
+}
+
+inline void writeCachedBones(CacheWriter &writer, const std::map<string, BoneInfo> &bones, int boneCount)
+{
+    writer.write(static_cast<uint32_t>(bones.size()));
+    for(std::map<string, BoneInfo>::const_iterator it = bones.begin(); it != bones.end(); ++it)
+    {
+        writer.writeString(it->first);
+        writer.write(it->second);
+    }
+    writer.write(static_cast<int32_t>(boneCount));
+}
+
+inline bool readCachedBones(CacheReader &reader, std::map<string, BoneInfo> &bones, int &boneCount)
+{
+    uint32_t count;
+    if(!reader.read(count))
+        return false;
+    bones.clear();
+    for(uint32_t i = 0; i < count; i++)
+    {
+        string name;
+        BoneInfo info;
+        if(!reader.readString(name) || !reader.read(info))
+            return false;
+        bones[name] = info;
+    }
+    int32_t counter;
+    if(!reader.read(counter))
+        return false;
+    boneCount = counter;
+    return true;
+}
+#endif
@@ -0,0 +1,140 @@
+#ifndef MODEL_STREAMER_H
+#define MODEL_STREAMER_H
+
+// Model comes from model.h, or from model_animation.h when that was included first
+#include <learnopengl/model.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/texture_loader.h>
+#include <learnopengl/thread_pool.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// default bytes of vertices, indices and pixels sent to the GPU per update()
+#define MODEL_STREAMER_BUDGET (4 * 1024 * 1024)
+
+// loads models without stalling the render loop. load() hands back the Model right away, still empty; a pool thread
+// imports it (or reads its cache) and converts the meshes, and update(), called once per frame on the GL thread,
+// uploads finished meshes and decoded textures until the frame's byte budget is spent. In the meantime the model draws
+// the meshes uploaded so far, textures still decoding show a flat placeholder, and Model::streaming drops to false
+// once everything is in. Textures go through the TextureCache like those of any other model.
+// skinned models (model_animation.h) get their bone info with the first update after the import; build Animations
+// for them once streaming is false.
+class ModelStreamer
+{
+public:
+    size_t uploadBudget;
+
+    // bytes uploaded by the last update(), at most one mesh or image over the budget
+    size_t bytesUploaded = 0;
+
+    explicit ModelStreamer(ThreadPool &pool, size_t uploadBudget = MODEL_STREAMER_BUDGET) : uploadBudget(uploadBudget), pool(pool) {}
+
+    // waits for imports still running. Models not finished by then stay partly uploaded, with streaming still true
+    ~ModelStreamer()
+    {
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            pool.wait(jobs[i]->group);
+            jobs[i]->model->textureLoader = NULL;
+        }
+    }
+
+    ModelStreamer(const ModelStreamer&) = delete;
+    ModelStreamer& operator=(const ModelStreamer&) = delete;
+
+    // starts loading the model at path, see Model's constructor for gamma, useCache and vertexFormat
+    std::shared_ptr<Model> load(const std::string &path, bool gamma = false, bool useCache = true, const VertexFormat &vertexFormat = VertexFormat())
+    {
+        std::unique_ptr<Job> job(new Job(pool));
+        job->model.reset(new Model());
+        job->model->gammaCorrection = gamma;
+        job->model->streaming = true;
+        job->staged.reset(new Model());
+        job->staged->gammaCorrection = gamma;
+        job->staged->deferUpload = true;
+        job->staged->vertexFormat = vertexFormat;
+        job->loader.placeholders = true;
+
+        Job *staging = job.get();
+        pool.submit(job->group, [staging, path, useCache]()
+            {
+                staging->staged->loadModel(path, useCache);
+            });
+        jobs.push_back(std::move(job));
+        return jobs.back()->model;
+    }
+
+    // models still loading
+    size_t pending() const
+    {
+        return jobs.size();
+    }
+
+    // uploads up to uploadBudget bytes, oldest model first, and finishes the models that are complete. Never waits on
+    // the pool. GL thread only
+    void update()
+    {
+        bytesUploaded = 0;
+        for (size_t i = 0; i < jobs.size(); )
+        {
+            Job &job = *jobs[i];
+            // the import task is done with the job once the group counts it as finished
+            const bool imported = job.group.pending.load() == 0;
+            if (imported)
+            {
+                if (!job.adopted)
+                {
+                    job.model->adoptStaged(*job.staged);
+                    job.model->textureLoader = &job.loader;
+                    job.adopted = true;
+                }
+                while (job.nextMesh < job.staged->meshes.size() && bytesUploaded < uploadBudget)
+                    uploadMesh(job);
+            }
+            if (bytesUploaded < uploadBudget)
+                bytesUploaded += job.loader.poll(uploadBudget - bytesUploaded);
+
+            if (imported && job.nextMesh == job.staged->meshes.size() && job.loader.done())
+            {
+                job.model->textureLoader = NULL;
+                job.model->streaming = false;
+                jobs.erase(jobs.begin() + i);
+                continue;
+            }
+            i++;
+        }
+    }
+
+private:
+    struct Job
+    {
+        explicit Job(ThreadPool &pool) : loader(pool) {}
+
+        // what the caller draws, filled mesh by mesh
+        std::shared_ptr<Model> model;
+        // built on the pool: meshes without buffers, textures as paths
+        std::unique_ptr<Model> staged;
+        TextureLoader loader;
+        // the import task, pending until it returns
+        TaskGroup group;
+        bool adopted = false;
+        size_t nextMesh = 0;
+    };
+
+    ThreadPool &pool;
+    std::vector<std::unique_ptr<Job>> jobs;
+
+    // gives the next staged mesh its textures (placeholders until decoded) and buffers, and hands it to the model
+    void uploadMesh(Job &job)
+    {
+        Mesh &mesh = job.staged->meshes[job.nextMesh++];
+        for (unsigned int i = 0; i < mesh.textures.size(); i++)
+            mesh.textures[i].id = job.model->loadTexture(mesh.textures[i].path.c_str(), mesh.textures[i].type).id;
+        mesh.upload();
+        bytesUploaded += mesh.uploadSize();
+        job.model->meshes.push_back(std::move(mesh));
+    }
+};
+#endif
@@ -0,0 +1,162 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// bit layout of a sort key, most significant first: shader | material | mesh | depth.
+// sorting by key groups draws by program, then textures, then VAO, and draws each group front to back.
+#define RENDER_KEY_SHADER_BITS   12
+#define RENDER_KEY_MATERIAL_BITS 18
+#define RENDER_KEY_MESH_BITS     18
+#define RENDER_KEY_DEPTH_BITS    16
+
+// one mesh of one visible entity, waiting to be drawn
+struct RenderItem {
+    Shader* shader;
+    Mesh* mesh;
+    const glm::mat4* model;
+};
+
+class RenderQueue
+{
+public:
+    // number of program switches done by the last submit
+    unsigned int shaderChanges = 0;
+
+    // builds the key of a draw. Only the ordering depends on it, so object names that don't fit their field
+    // are simply truncated: two different meshes sharing a key still draw correctly, just not grouped.
+    static uint64_t makeKey(unsigned int shader, unsigned int material, unsigned int mesh, float depth)
+    {
+        // positive IEEE floats sort like their bit patterns, so the top bits give a coarse, monotonic depth
+        if (!(depth > 0.0f))
+            depth = 0.0f;
+        uint32_t depthBits;
+        std::memcpy(&depthBits, &depth, sizeof(float));
+
+        uint64_t key = shader & ((1u << RENDER_KEY_SHADER_BITS) - 1);
+        key = (key << RENDER_KEY_MATERIAL_BITS) | (material & ((1u << RENDER_KEY_MATERIAL_BITS) - 1));
+        key = (key << RENDER_KEY_MESH_BITS) | (mesh & ((1u << RENDER_KEY_MESH_BITS) - 1));
+        key = (key << RENDER_KEY_DEPTH_BITS) | (depthBits >> (32 - RENDER_KEY_DEPTH_BITS));
+        return key;
+    }
+
+    // drops all queued items but keeps the memory, so a queue reused every frame stops allocating
+    void clear()
+    {
+        items.clear();
+        entries.clear();
+    }
+
+    // queues every mesh of the model. depth is the view-space distance used to order draws front to back.
+    void push(Shader& shader, Model& model, const glm::mat4& modelMatrix, float depth)
+    {
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+        {
+            Mesh& mesh = model.meshes[i];
+            // the first texture stands in for the material, meshes of a model that share it share the rest too
+            unsigned int material = mesh.textures.empty() ? 0 : mesh.textures[0].id;
+
+            SortEntry entry;
+            entry.key = makeKey(shader.ID, material, mesh.VAO, depth);
+            entry.index = static_cast<uint32_t>(items.size());
+            entries.push_back(entry);
+
+            RenderItem item;
+            item.shader = &shader;
+            item.mesh = &mesh;
+            item.model = &modelMatrix;
+            items.push_back(item);
+        }
+    }
+
+    // orders the queued items by key with an LSD radix sort, 8 bits per pass.
+    // passes where every key has the same digit are skipped, which is most of them for the shader field.
+    void sort()
+    {
+        const size_t count = entries.size();
+        if (count < 2)
+            return;
+
+        // one histogram per byte, all filled in a single pass over the keys
+        uint32_t histograms[8][256];
+        std::memset(histograms, 0, sizeof(histograms));
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t key = entries[i].key;
+            for (int pass = 0; pass < 8; pass++)
+                histograms[pass][(key >> (pass * 8)) & 0xFF]++;
+        }
+
+        scratch.resize(count);
+        SortEntry* src = entries.data();
+        SortEntry* dst = scratch.data();
+        for (int pass = 0; pass < 8; pass++)
+        {
+            uint32_t* histogram = histograms[pass];
+            const unsigned int shift = pass * 8;
+            if (histogram[(src[0].key >> shift) & 0xFF] == count)
+                continue;
+
+            // turn counts into starting offsets
+            uint32_t offset = 0;
+            for (int digit = 0; digit < 256; digit++)
+            {
+                uint32_t digitCount = histogram[digit];
+                histogram[digit] = offset;
+                offset += digitCount;
+            }
+            for (size_t i = 0; i < count; i++)
+                dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+            std::swap(src, dst);
+        }
+        if (src != entries.data())
+            entries.swap(scratch);
+    }
+
+    // draws the queued items in key order, switching programs only when the key says so
+    void submit()
+    {
+        constexpr UniformHandle modelUniform("model");
+        shaderChanges = 0;
+        Shader* currentShader = nullptr;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            const RenderItem& item = items[entries[i].index];
+            if (item.shader != currentShader)
+            {
+                currentShader = item.shader;
+                currentShader->use();
+                shaderChanges++;
+            }
+            currentShader->setMat4(modelUniform, *item.model);
+            item.mesh->drawBatched(*currentShader);
+        }
+        // the whole queue is one batch: meshes skip the binds they share, and nothing stays bound after it
+        if (!entries.empty())
+            GLState::get().endBatch();
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<RenderItem> items;
+    std::vector<SortEntry> entries;
+    std::vector<SortEntry> scratch;
+};
+#endif
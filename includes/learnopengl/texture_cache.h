@@ -0,0 +1,216 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/texture_loader.h>
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// what a texture was loaded from and how: two requests share a texture only when all of it matches
+struct TextureKey
+{
+    std::string path;
+    bool gamma;
+    int channels;
+
+    bool operator==(const TextureKey &other) const
+    {
+        return gamma == other.gamma && channels == other.channels && path == other.path;
+    }
+};
+
+struct TextureKeyHash
+{
+    size_t operator()(const TextureKey &key) const
+    {
+        return std::hash<std::string>()(key.path) ^ (static_cast<size_t>(key.channels) << 1) ^ static_cast<size_t>(key.gamma);
+    }
+};
+
+// absolute form of path with '/' separators, so different spellings of the same file meet in the cache. Files that
+// can't be resolved keep the path they were asked for
+inline std::string canonicalTexturePath(const std::string &path)
+{
+    std::string result = path;
+#ifdef _WIN32
+    char buffer[_MAX_PATH];
+    if (_fullpath(buffer, path.c_str(), _MAX_PATH))
+        result = buffer;
+    for (size_t i = 0; i < result.size(); i++)
+        result[i] = result[i] == '\\' ? '/' : static_cast<char>(std::tolower(static_cast<unsigned char>(result[i])));
+#else
+    char *resolved = realpath(path.c_str(), NULL);
+    if (resolved)
+    {
+        result = resolved;
+        free(resolved);
+    }
+#endif
+    return result;
+}
+
+// 64 bit FNV-1a of the file's bytes; false if it can't be read
+inline bool hashFileContents(const std::string &path, uint64_t &hash)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    hash = 14695981039346656037ull;
+    unsigned char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            hash ^= buffer[i];
+            hash *= 1099511628211ull;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// process-wide cache of textures loaded from files, so every model (and every copy of one) that uses an image shares
+// one decode and one GL texture. Lookups are hashed on the canonical path plus load parameters; each acquire() holds
+// a reference that release() gives back, and the texture is deleted with its last reference.
+// With verifyContent, a file not found by name is also hashed, and byte-identical files under other names share the
+// texture already loaded (at the price of reading each new file one more time).
+// textures are GL objects, so the cache belongs to the GL thread; the decoding can go to a TextureLoader's pool
+class TextureCache
+{
+public:
+    bool verifyContent = false;
+
+    // textures decoded, requests served from the cache, and files merged with another by their content
+    unsigned int decodes = 0;
+    unsigned int hits = 0;
+    unsigned int contentMatches = 0;
+
+    // one cache per context; this repo only ever creates one
+    static TextureCache& get()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // returns the texture holding the image at path, loading it on a miss: through loader when given (ready after its
+    // finish()), otherwise right away. Counts as one reference until the matching release()
+    unsigned int acquire(const std::string &path, bool gamma = false, int channels = 0, TextureLoader *loader = NULL)
+    {
+        TextureKey key;
+        key.path = canonicalTexturePath(path);
+        key.gamma = gamma;
+        key.channels = channels;
+
+        std::unordered_map<TextureKey, unsigned int, TextureKeyHash>::iterator found = byKey.find(key);
+        if (found != byKey.end())
+        {
+            hits++;
+            entries[found->second].references++;
+            return found->second;
+        }
+
+        // the content key folds in the load parameters too, an sRGB and a linear copy of one file stay apart
+        uint64_t contentHash = 0;
+        const bool hashed = verifyContent && hashFileContents(key.path, contentHash);
+        if (hashed)
+        {
+            contentHash ^= (static_cast<uint64_t>(channels) << 1) ^ static_cast<uint64_t>(gamma);
+            std::unordered_map<uint64_t, unsigned int>::iterator same = byContent.find(contentHash);
+            if (same != byContent.end())
+            {
+                contentMatches++;
+                Entry &entry = entries[same->second];
+                entry.references++;
+                entry.keys.push_back(key);
+                byKey[key] = same->second;
+                return same->second;
+            }
+        }
+
+        unsigned int texture;
+        if (loader)
+            texture = loader->request(key.path, gamma, channels);
+        else
+        {
+            glGenTextures(1, &texture);
+            DecodedImage image = decodeImage(key.path, channels);
+            image.gamma = gamma;
+            uploadImage(texture, image);
+        }
+        decodes++;
+
+        Entry &entry = entries[texture];
+        entry.references = 1;
+        entry.keys.push_back(key);
+        entry.hashed = hashed;
+        entry.contentHash = contentHash;
+        byKey[key] = texture;
+        if (hashed)
+            byContent[contentHash] = texture;
+        return texture;
+    }
+
+    // one more reference to a texture acquired before, e.g. for a copy of whatever holds it
+    void retain(unsigned int texture)
+    {
+        std::unordered_map<unsigned int, Entry>::iterator found = entries.find(texture);
+        if (found != entries.end())
+            found->second.references++;
+    }
+
+    // gives back one reference, deleting the texture with the last. Textures the cache didn't create are ignored
+    void release(unsigned int texture)
+    {
+        std::unordered_map<unsigned int, Entry>::iterator found = entries.find(texture);
+        if (found == entries.end() || --found->second.references > 0)
+            return;
+
+        const Entry &entry = found->second;
+        for (size_t i = 0; i < entry.keys.size(); i++)
+            byKey.erase(entry.keys[i]);
+        if (entry.hashed)
+            byContent.erase(entry.contentHash);
+        entries.erase(found);
+
+        glDeleteTextures(1, &texture);
+        // the name can come back from glGenTextures, so the shadowed bindings no longer mean anything
+        GLState::get().invalidate();
+    }
+
+    // textures alive in the cache
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+    unsigned int references(unsigned int texture) const
+    {
+        std::unordered_map<unsigned int, Entry>::const_iterator found = entries.find(texture);
+        return found == entries.end() ? 0 : found->second.references;
+    }
+
+private:
+    struct Entry
+    {
+        unsigned int references = 0;
+        // every name the texture was requested under
+        std::vector<TextureKey> keys;
+        bool hashed = false;
+        uint64_t contentHash = 0;
+    };
+
+    std::unordered_map<TextureKey, unsigned int, TextureKeyHash> byKey;
+    std::unordered_map<uint64_t, unsigned int> byContent;
+    std::unordered_map<unsigned int, Entry> entries;
+};
+#endif
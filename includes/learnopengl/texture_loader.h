@@ -0,0 +1,187 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/thread_pool.h>
+
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+// an image decoded into CPU memory, waiting to be uploaded. pixels is NULL when decoding failed
+struct DecodedImage
+{
+    std::string filename;
+    unsigned char *pixels = NULL;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    // stored as sRGB, so sampling converts it to linear
+    bool gamma = false;
+    // texture the image goes into
+    unsigned int texture = 0;
+};
+
+// reads and decodes filename, converted to channels components (0 keeps the file's own). Touches no GL state, so it
+// runs on any thread
+inline DecodedImage decodeImage(const std::string &filename, int channels = 0)
+{
+    DecodedImage image;
+    image.filename = filename;
+    image.pixels = stbi_load(filename.c_str(), &image.width, &image.height, &image.components, channels);
+    if (channels != 0)
+        image.components = channels;
+    return image;
+}
+
+// uploads image into texture with mipmaps and repeat/trilinear sampling, then frees its pixels. GL thread only
+inline void uploadImage(unsigned int texture, DecodedImage &image)
+{
+    if (image.pixels)
+    {
+        GLenum format = GL_RGB;
+        if (image.components == 1)
+            format = GL_RED;
+        else if (image.components == 3)
+            format = GL_RGB;
+        else if (image.components == 4)
+            format = GL_RGBA;
+        GLenum internalFormat = format;
+        if (image.gamma && format == GL_RGB)
+            internalFormat = GL_SRGB;
+        else if (image.gamma && format == GL_RGBA)
+            internalFormat = GL_SRGB_ALPHA;
+
+        GLState::get().bindTexture2D(0, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    else
+    {
+        std::cout << "Texture failed to load at path: " << image.filename << std::endl;
+    }
+    stbi_image_free(image.pixels);
+    image.pixels = NULL;
+}
+
+// splits texture loading into decoding, spread over a thread pool, and uploading, left to the GL thread.
+// request() names the texture right away, so meshes can be built with its id while the image is still decoding;
+// finish() then uploads the images in the order they come out of the pool.
+// usage, all on the GL thread:
+//     TextureLoader loader(pool);
+//     unsigned int id = loader.request(directory + "/diffuse.png");   // as many as needed
+//     loader.finish();                                                 // every requested texture has its image now
+class TextureLoader
+{
+public:
+    // textures requested, and how many of them have their image uploaded
+    unsigned int requested = 0;
+    unsigned int uploaded = 0;
+
+    // give every requested texture a 1x1 image of placeholderColor right away, so it can be drawn with while decoding
+    bool placeholders = false;
+    unsigned char placeholderColor[4] = { 128, 128, 128, 255 };
+
+    explicit TextureLoader(ThreadPool &pool) : pool(pool) {}
+
+    // waits for whatever is still decoding, so no task outlives the loader
+    ~TextureLoader()
+    {
+        finish();
+    }
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    // returns a new texture that receives filename's image once finish() uploads it. gamma and channels as in
+    // DecodedImage and decodeImage
+    unsigned int request(const std::string &filename, bool gamma = false, int channels = 0)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        if (placeholders)
+        {
+            GLState::get().bindTexture2D(0, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholderColor);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        requested++;
+        pool.submit(group, [this, filename, texture, gamma, channels]()
+            {
+                DecodedImage image = decodeImage(filename, channels);
+                image.gamma = gamma;
+                image.texture = texture;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    decoded.push_back(image);
+                }
+                ready.notify_one();
+            });
+        return texture;
+    }
+
+    // uploads each image as soon as it's decoded, until every requested one is in. GL thread only
+    void finish()
+    {
+        while (uploaded < requested)
+        {
+            DecodedImage image;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this]() { return !decoded.empty(); });
+                image = decoded.front();
+                decoded.pop_front();
+            }
+            uploadImage(image.texture, image);
+            uploaded++;
+        }
+        pool.wait(group);
+    }
+
+    // uploads the images decoded so far without waiting for the rest, stopping once byteBudget bytes of pixels went to
+    // GL (the last image may go over). Returns the bytes uploaded. GL thread only
+    size_t poll(size_t byteBudget)
+    {
+        size_t bytes = 0;
+        while (bytes < byteBudget)
+        {
+            DecodedImage image;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (decoded.empty())
+                    break;
+                image = decoded.front();
+                decoded.pop_front();
+            }
+            bytes += static_cast<size_t>(image.width) * image.height * image.components;
+            uploadImage(image.texture, image);
+            uploaded++;
+        }
+        return bytes;
+    }
+
+    // every requested image is uploaded and no decode task is left, so the loader can go without waiting
+    bool done() const
+    {
+        return uploaded == requested && group.pending.load() == 0;
+    }
+
+private:
+    ThreadPool &pool;
+    TaskGroup group;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<DecodedImage> decoded;
+};
+#endif
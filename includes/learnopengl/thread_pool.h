@@ -0,0 +1,223 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// counts the tasks of one batch of work that haven't finished yet. ThreadPool::wait() blocks on it.
+struct TaskGroup
+{
+    std::atomic<int> pending{0};
+};
+
+// fixed set of worker threads with one task deque each. A worker pops its own newest task first (cache-warm, and
+// keeps recursive splitting depth-first) and steals the oldest task of another worker when it runs dry (the biggest
+// chunks of work, so steals stay rare). Workers waiting on a TaskGroup run any task instead of idling, so tasks may
+// submit and wait on nested tasks freely. Other threads (the GL thread) only help with the group they wait on, so a
+// wait there never picks up some unrelated long task, like a model import, and runs it inline.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency())
+    {
+        if (threadCount == 0)
+            threadCount = 1;
+        // the last queue is shared by every thread that isn't a worker of this pool
+        for (unsigned int i = 0; i <= threadCount; i++)
+            queues.emplace_back(new WorkQueue());
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleepCondition.notify_all();
+        for (unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const
+    {
+        return static_cast<unsigned int>(workers.size());
+    }
+
+    // queues task as part of group. Called from a worker, the task goes to that worker's own deque.
+    void submit(TaskGroup& group, std::function<void()> task)
+    {
+        group.pending++;
+        WorkQueue& queue = *queues[currentQueue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(Task{ std::move(task), &group });
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued++;
+        }
+        sleepCondition.notify_one();
+    }
+
+    // returns once every task of group (and anything they submitted to it) has run, helping out in the meantime:
+    // with any task on a worker, with tasks of group only on other threads
+    void wait(TaskGroup& group)
+    {
+        const unsigned int self = currentQueue();
+        TaskGroup* only = workerPool() == this ? nullptr : &group;
+        while (group.pending.load() > 0)
+        {
+            if (!runOne(self, only))
+                std::this_thread::yield();
+        }
+    }
+
+    // calls body(rangeBegin, rangeEnd) over [begin, end) split into chunks of at most grain items, and waits for all
+    template<typename Body>
+    void parallelFor(size_t begin, size_t end, size_t grain, const Body& body)
+    {
+        if (grain == 0)
+            grain = 1;
+        TaskGroup group;
+        while (end - begin > grain)
+        {
+            const size_t chunkEnd = begin + grain;
+            submit(group, [&body, begin, chunkEnd]() { body(begin, chunkEnd); });
+            begin = chunkEnd;
+        }
+        // the calling thread takes the last chunk itself
+        if (begin < end)
+            body(begin, end);
+        wait(group);
+    }
+
+private:
+    struct Task
+    {
+        std::function<void()> function;
+        TaskGroup* group;
+    };
+
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+
+    // sleeping workers wake up when queued goes above zero
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    int queued = 0;
+    bool stopping = false;
+
+    // index of the calling thread's queue in the pool it's a worker of, or -1 on any other thread
+    static int& workerIndex()
+    {
+        static thread_local int index = -1;
+        return index;
+    }
+    static ThreadPool*& workerPool()
+    {
+        static thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    unsigned int currentQueue() const
+    {
+        return workerPool() == this ? static_cast<unsigned int>(workerIndex()) : static_cast<unsigned int>(workers.size());
+    }
+
+    // first task of group in any queue, for threads that must not run anything else
+    bool takeGroupTask(const TaskGroup* group, Task& task)
+    {
+        for (unsigned int i = 0; i < queues.size(); i++)
+        {
+            WorkQueue& queue = *queues[i];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            for (std::deque<Task>::iterator it = queue.tasks.begin(); it != queue.tasks.end(); ++it)
+            {
+                if (it->group == group)
+                {
+                    task = std::move(*it);
+                    queue.tasks.erase(it);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool takeTask(unsigned int self, Task& task)
+    {
+        // own queue, newest first
+        {
+            WorkQueue& queue = *queues[self];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty())
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+                return true;
+            }
+        }
+        // steal someone else's oldest
+        const unsigned int count = static_cast<unsigned int>(queues.size());
+        for (unsigned int i = 1; i < count; i++)
+        {
+            WorkQueue& queue = *queues[(self + i) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty())
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // runs one task, any or only one of group when given
+    bool runOne(unsigned int self, const TaskGroup* group = nullptr)
+    {
+        Task task;
+        if (group ? !takeGroupTask(group, task) : !takeTask(self, task))
+            return false;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued--;
+        }
+        task.function();
+        task.group->pending--;
+        return true;
+    }
+
+    void workerLoop(unsigned int index)
+    {
+        workerPool() = this;
+        workerIndex() = static_cast<int>(index);
+        while (true)
+        {
+            if (runOne(index))
+                continue;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCondition.wait(lock, [this]() { return stopping || queued > 0; });
+            if (stopping && queued == 0)
+                return;
+        }
+    }
+};
+#endif
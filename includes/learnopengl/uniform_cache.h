@@ -0,0 +1,141 @@
+#ifndef UNIFORM_CACHE_H
+#define UNIFORM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+// FNV-1a hash of a uniform name. constexpr so names known at compile time never get hashed at runtime.
+constexpr unsigned int hashUniformName(const char* name)
+{
+    unsigned int hash = 2166136261u;
+    while (*name)
+    {
+        hash ^= static_cast<unsigned char>(*name++);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// hashed uniform name taken by Shader::set*. Strings still convert implicitly, but a handle declared as
+// constexpr UniformHandle MODEL("model"); is hashed at compile time so hot loops never touch strings.
+struct UniformHandle
+{
+    unsigned int hash;
+
+    constexpr UniformHandle(const char* name) : hash(hashUniformName(name)) {}
+    UniformHandle(const std::string& name) : hash(hashUniformName(name.c_str())) {}
+};
+
+// flat open-addressing table of uniform name hash -> location, filled once after a program is linked.
+class UniformCache
+{
+public:
+    // enumerates every active uniform of the program and stores its location.
+    // array uniforms are stored both as "name" and as each "name[i]" element.
+    // ------------------------------------------------------------------------
+    void build(unsigned int program)
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        // keep the load factor at or below 50% (arrays add one entry per element, so count them first)
+        std::vector<std::string> names;
+        std::vector<GLint> sizes;
+        std::vector<char> buffer(maxLength > 0 ? maxLength : 1);
+        unsigned int entries = 0;
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(program, i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            names.push_back(std::string(buffer.data(), length));
+            sizes.push_back(size);
+            entries += size + 1;
+        }
+        unsigned int capacity = 16;
+        while (capacity < entries * 2)
+            capacity <<= 1;
+        slots.assign(capacity, Slot());
+        mask = capacity - 1;
+
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            std::string name = names[i];
+            // array uniforms are reported as "name[0]"
+            bool isArray = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+            if (isArray)
+                name.resize(name.size() - 3);
+
+            GLint location = glGetUniformLocation(program, names[i].c_str());
+            if (location == -1) // uniforms inside a uniform block have no location
+                continue;
+            insert(name, location);
+            if (isArray)
+            {
+                for (GLint j = 0; j < sizes[i]; j++)
+                {
+                    std::string element = name + "[" + std::to_string(j) + "]";
+                    insert(element, glGetUniformLocation(program, element.c_str()));
+                }
+            }
+        }
+    }
+    // returns -1 for unknown names, which glUniform* silently ignores just like a failed glGetUniformLocation
+    // ------------------------------------------------------------------------
+    GLint location(unsigned int hash) const
+    {
+        if (slots.empty())
+            return -1;
+        for (unsigned int i = hash & mask; ; i = (i + 1) & mask)
+        {
+            const Slot& slot = slots[i];
+            if (slot.location == EMPTY)
+                return -1;
+            if (slot.hash == hash)
+                return slot.location;
+        }
+    }
+    GLint location(UniformHandle name) const
+    {
+        return location(name.hash);
+    }
+
+private:
+    static const GLint EMPTY = -2;
+
+    struct Slot
+    {
+        unsigned int hash = 0;
+        GLint location = EMPTY;
+    };
+
+    std::vector<Slot> slots;
+    unsigned int mask = 0;
+
+    void insert(const std::string& name, GLint location)
+    {
+        unsigned int hash = hashUniformName(name.c_str());
+        for (unsigned int i = hash & mask; ; i = (i + 1) & mask)
+        {
+            Slot& slot = slots[i];
+            if (slot.location == EMPTY)
+            {
+                slot.hash = hash;
+                slot.location = location;
+                return;
+            }
+            if (slot.hash == hash)
+            {
+                if (slot.location != location)
+                    std::cout << "ERROR::UNIFORM_CACHE::HASH_COLLISION for uniform: " << name << std::endl;
+                return;
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,158 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// how texture coordinates are stored in the vertex buffer
+enum TexCoordEncoding {
+    TEXCOORD_FLOAT,
+    TEXCOORD_HALF,
+    // 16-bit fixed point in [0, 1]; meshes with coordinates outside that range fall back to TEXCOORD_HALF
+    TEXCOORD_UNORM16
+};
+
+// what a mesh may compress when its buffers are created. Each option changes what the vertex shader receives, so the
+// default is the full float layout the shaders in this repo are written for. With the compact options:
+//  - location 1 is a vec2, the octahedral normal: decode with octahedralDecode below, ported to GLSL;
+//  - location 3 is a vec3, the octahedral tangent in xy and the sign of the bitangent in z, and location 4 is unused:
+//    bitangent = cross(normal, tangent) * tangent.z;
+//  - location 5 has unused influences as bone 0 with weight 0 instead of -1, and locations 5 and 6 are unused for
+//    meshes without bone weights;
+// texture coordinates and indices need no change in the shader.
+struct VertexFormat {
+    bool octahedralNormals = false;
+    TexCoordEncoding texCoords = TEXCOORD_FLOAT;
+    // bone ids as 8-bit integers (16-bit past 256 bones) and weights as unorm8, or no bone attributes when unskinned
+    bool compactSkinning = false;
+    // 16-bit indices for meshes of up to 65536 vertices
+    bool shortIndices = false;
+
+    // every option on
+    static VertexFormat compact()
+    {
+        VertexFormat format;
+        format.octahedralNormals = true;
+        format.texCoords = TEXCOORD_HALF;
+        format.compactSkinning = true;
+        format.shortIndices = true;
+        return format;
+    }
+};
+
+// which member of Vertex an attribute is made from
+enum VertexSemantic {
+    VERTEX_POSITION,
+    VERTEX_NORMAL,
+    VERTEX_TEXCOORDS,
+    VERTEX_TANGENT,
+    VERTEX_BITANGENT,
+    VERTEX_BONE_IDS,
+    VERTEX_BONE_WEIGHTS
+};
+
+struct VertexAttribute {
+    VertexSemantic semantic;
+    unsigned int location;
+    int components;
+    GLenum type;
+    GLboolean normalized;
+    // read as an ivec through glVertexAttribIPointer
+    bool integer;
+    unsigned int offset;
+};
+
+// the vertex and index encoding one mesh was uploaded with
+struct VertexLayout {
+    std::vector<VertexAttribute> attributes;
+    unsigned int stride = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    // false when the buffer holds the Vertex structs as they are, with stride and offsets taken from Vertex
+    bool packed = false;
+
+    // appends an attribute at the end of the vertex, each one starting on a 4 byte boundary
+    void add(VertexSemantic semantic, unsigned int location, int components, GLenum type, GLboolean normalized, bool integer = false)
+    {
+        VertexAttribute attribute;
+        attribute.semantic = semantic;
+        attribute.location = location;
+        attribute.components = components;
+        attribute.type = type;
+        attribute.normalized = normalized;
+        attribute.integer = integer;
+        attribute.offset = stride;
+        attributes.push_back(attribute);
+        stride += (components * componentSize(type) + 3) & ~3u;
+    }
+
+    unsigned int indexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    }
+
+    static unsigned int componentSize(GLenum type)
+    {
+        switch(type)
+        {
+            case GL_BYTE:
+            case GL_UNSIGNED_BYTE:
+                return 1;
+            case GL_SHORT:
+            case GL_UNSIGNED_SHORT:
+            case GL_HALF_FLOAT:
+                return 2;
+            default:
+                return 4;
+        }
+    }
+};
+
+// maps a unit vector onto the octahedron |x| + |y| + |z| = 1 and unfolds it into [-1, 1]^2
+inline glm::vec2 octahedralEncode(glm::vec3 n)
+{
+    n /= glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z) + 1e-20f;
+    glm::vec2 e(n.x, n.y);
+    if(n.z < 0.0f)
+    {
+        // fold the lower half over the diagonals
+        e.x = (1.0f - glm::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - glm::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+inline glm::vec3 octahedralDecode(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - glm::abs(e.x) - glm::abs(e.y));
+    const float t = glm::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+// up to four weights as unorm8 that still add up to 255 when the weights add up to one, so rounding doesn't
+// shrink or grow the skinned vertex
+inline uint32_t packBoneWeights(const float weights[4])
+{
+    int quantized[4];
+    int sum = 0;
+    int largest = 0;
+    for(int i = 0; i < 4; i++)
+    {
+        quantized[i] = static_cast<int>(glm::clamp(weights[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+        sum += quantized[i];
+        if(quantized[i] > quantized[largest])
+            largest = i;
+    }
+    const float total = weights[0] + weights[1] + weights[2] + weights[3];
+    if(sum > 0 && glm::abs(total - 1.0f) < 0.01f)
+        quantized[largest] = glm::clamp(quantized[largest] + 255 - sum, 0, 255);
+    return static_cast<uint32_t>(quantized[0]) | static_cast<uint32_t>(quantized[1]) << 8 |
+           static_cast<uint32_t>(quantized[2]) << 16 | static_cast<uint32_t>(quantized[3]) << 24;
+}
+#endif